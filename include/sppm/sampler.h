@@ -0,0 +1,136 @@
+#ifndef SPPM_SAMPLER_H_
+#define SPPM_SAMPLER_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ==================================================== //
+// Embedding API of libsppm. A sampler is built from a graph and attribute
+// arrays in memory and hands every held sample to a callback; the sampler
+// reads and writes no files. Its log is off unless SPPM_Options::log is set.
+// The library bundles Easylogging++ for it and logs through loggers of its
+// own ("sppm", and one per sampler), which never write to files or the
+// standard output; the loggers of a program that logs through the same
+// Easylogging++ are left as they are.
+//
+// Example:
+//
+//   std::unique_ptr<SPPM_Sampler> sampler =
+//       SPPM_Sampler::Normal(graph, y.data(), 3, 1, 2, 1, options);
+//   sampler->SetCallback([&](const SPPM_Sample& sample) { ... });
+//   sampler->Run(10000);
+// ==================================================== //
+
+// The graph in compressed sparse row form: the neighbours of node i are
+// adjacency[offsets[i]] .. adjacency[offsets[i + 1] - 1], and every edge is
+// listed exactly once from each of its ends (no self-loops). The factories
+// throw std::invalid_argument for any other graph. The arrays are only read
+// while the sampler is built.
+struct SPPM_GraphView {
+	int num_nodes;
+	const int* offsets;
+	const int* adjacency;
+};
+
+// ========================== //
+
+struct SPPM_Options {
+	uint64_t seed;
+	uint32_t chain;
+	int num_threads;
+
+	// Uniform spanning trees (Wilson) instead of minimum spanning trees of
+	// random weights (Kruskal)
+	bool wilson_trees;
+	double split_merge_rate;
+
+	// Beta prior of rho
+	double rho_alpha;
+	double rho_beta;
+
+	// Samples are held (passed to the callback) every thinning iterations
+	// after the burn-in. The initial state is also held, as iteration 0.
+	int burn_in;
+	int thinning;
+
+	// Start from this many groups instead of one group per node (0)
+	int init_groups;
+
+	// Receives each line of the sampler's log with its level ("INFO",
+	// "WARNING", "ERROR"...), from the thread running the sampler, until the
+	// sampler is destroyed. The log is off if it is empty.
+	typedef std::function<void(const std::string& level,
+		const std::string& message)> Log;
+	Log log;
+
+	SPPM_Options()
+		: seed(1), chain(0), num_threads(1), wilson_trees(false),
+		  split_merge_rate(0), rho_alpha(2), rho_beta(5), burn_in(100),
+		  thinning(10), init_groups(0) {
+	}
+};
+
+// ========================== //
+
+// A held sample. The references are valid during the callback only.
+struct SPPM_Sample {
+	int iteration;
+	int num_groups;
+	double rho;
+
+	// Group of each node (1..num_groups), by node index
+	const std::vector<long long>& labels;
+
+	// Edges of the spanning tree, as pairs of node indices
+	const std::vector<std::pair<long long, long long>>& tree;
+
+	// theta[k][g] is the k-th parameter of group g (normal: mu and tau,
+	// poisson: the relative risk); theta[k][0] is not used
+	const std::vector<std::vector<double>>& theta;
+};
+
+// ========================== //
+
+class SPPM_Sampler {
+	public:
+		typedef std::function<void(const SPPM_Sample&)> Callback;
+
+		// Normal model: y ~ N(mu, 1/tau) in each group, with (mu, tau) from a
+		// Normal-Gamma(m, v, a, b). y has an entry per node.
+		static std::unique_ptr<SPPM_Sampler> Normal(const SPPM_GraphView& graph,
+			const double* y, double a, double b, double m, double v,
+			const SPPM_Options& options = SPPM_Options());
+
+		// Poisson model: y ~ Poisson(e theta) in each group, with theta from
+		// a Gamma(a, b). y and e have an entry per node.
+		static std::unique_ptr<SPPM_Sampler> Poisson(const SPPM_GraphView& graph,
+			const double* y, const double* e, double a, double b,
+			const SPPM_Options& options = SPPM_Options());
+
+		~SPPM_Sampler();
+
+		void SetCallback(const Callback& callback);
+
+		// Runs up to num_iter more iterations, stopping early once
+		// max_seconds have passed (0 for no limit). The first call draws (and
+		// holds) the initial state; later calls continue the chain. Returns
+		// the number of iterations run.
+		int Run(int num_iter, double max_seconds = 0);
+
+		// Iterations run so far
+		int Iteration() const;
+
+	private:
+		struct Impl;
+		std::unique_ptr<Impl> m_impl;
+
+		explicit SPPM_Sampler(Impl* impl);
+};
+
+// ==================================================== //
+
+#endif // SPPM_SAMPLER_H_
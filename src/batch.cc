@@ -0,0 +1,134 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#include "easylogging++.h"
+#include "graph_copy.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// ==================================================== //
+
+vector<BatchRun> ReadManifest(const string& filename, const BatchRun& defaults) {
+	ifstream file(filename);
+	if (!file) {
+		throw std::ios_base::failure("Failed to read manifest: " + filename);
+	}
+
+	vector<BatchRun> runs;
+	string line;
+	int line_number = 0;
+	while (getline(file, line)) {
+		++line_number;
+		istringstream tokens(line);
+		string token;
+		if (!(tokens >> token) || token[0] == '#') continue;
+
+		BatchRun run = defaults;
+		run.output_dir = token;
+		if (!(tokens >> run.model)) {
+			throw std::invalid_argument("Manifest line " + to_string(line_number)
+				+ ": missing model");
+		}
+		run.args.clear();
+		while (tokens >> token) {
+			size_t eq = token.find('=');
+			if (eq == string::npos) {
+				run.args.push_back(token);
+				continue;
+			}
+			string key = token.substr(0, eq);
+			string value = token.substr(eq + 1);
+			if (key == "num_iter") run.num_iter = stoi(value);
+			else if (key == "burn_in") run.burn_in = stoi(value);
+			else if (key == "thinning") run.thinning = stoi(value);
+			else if (key == "seed") run.seed = stoull(value);
+			else {
+				throw std::invalid_argument("Manifest line " + to_string(line_number)
+					+ ": unknown option '" + key + "'");
+			}
+		}
+		runs.push_back(run);
+	}
+	return runs;
+}
+
+// ==================================================== //
+
+BatchRunner::BatchRunner(lemon::SmartGraph& graph,
+	lemon::SmartGraph::NodeMap<long long>& node_id,
+	lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute, Factory factory)
+
+	: m_graph(graph), m_node_id(node_id), m_node_attr(node_attribute),
+	  m_factory(factory), m_num_threads(1) {
+}
+
+// ========================== //
+
+void BatchRunner::SetNumThreads(int num_threads) {
+	LOG(INFO) << "== Batch runs at a time: " << num_threads;
+	m_num_threads = max(num_threads, 1);
+}
+
+// ========================== //
+
+int BatchRunner::Run(vector<BatchRun> runs) {
+	int num_workers = min<int>(m_num_threads, runs.size());
+	LOG(INFO) << "== Running a batch of " << runs.size() << " runs on "
+		<< num_workers << " thread(s)";
+
+	// Longest runs first: the short ones fill the gaps at the end
+	stable_sort(runs.begin(), runs.end(),
+		[](const BatchRun& a, const BatchRun& b) { return a.num_iter > b.num_iter; });
+
+	// The first worker runs on the loaded graph, the others on copies
+	vector<unique_ptr<GraphCopy>> copies;
+	for (int k = 1; k < num_workers; ++k) {
+		copies.emplace_back(new GraphCopy(m_graph, m_node_id, m_node_attr));
+	}
+
+	atomic<int> next(0);
+	atomic<int> num_failed(0);
+	ThreadPool pool(num_workers);
+	pool.ParallelFor(num_workers, [&](int k) {
+		lemon::SmartGraph& graph = k == 0 ? m_graph : copies[k - 1]->graph;
+		lemon::SmartGraph::NodeMap<long long>& node_id =
+			k == 0 ? m_node_id : copies[k - 1]->node_id;
+		lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute =
+			k == 0 ? m_node_attr : copies[k - 1]->node_attribute;
+
+		for (int i = next++; i < static_cast<int>(runs.size()); i = next++) {
+			const BatchRun& run = runs[i];
+			LOG(INFO) << "== Batch run '" << run.output_dir << "' (" << run.model
+				<< ", " << run.num_iter << " iterations)";
+			try {
+				if (mkdir(run.output_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+					throw std::ios_base::failure("Failed to create directory: "
+						+ run.output_dir);
+				}
+				unique_ptr<SPPM> sppm = m_factory(run, graph, node_id, node_attribute);
+				sppm->SetOutputDirectory(run.output_dir);
+				sppm->SetShowProgress(false);
+				// Concurrent runs would overwrite each other's file
+				sppm->SetPrometheusFile("");
+				sppm->Run(run.num_iter, run.burn_in, run.thinning);
+			} catch (const std::exception& e) {
+				LOG(ERROR) << "Batch run '" << run.output_dir << "' failed: " << e.what();
+				num_failed++;
+			}
+		}
+	});
+
+	LOG(INFO) << "== Batch finished: " << runs.size() - num_failed << " of "
+		<< runs.size() << " runs succeeded";
+	return num_failed;
+}
+
+// ==================================================== //
@@ -0,0 +1,74 @@
+#ifndef SPPM_BATCH_H_
+#define SPPM_BATCH_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <lemon/smart_graph.h>
+
+#include "sppm.h"
+#include "util.h"
+
+// ========================== //
+
+// One run of a batch: a model ("normal" or "poisson") with its command-line
+// arguments after the GeoJSON file, the directory its output files go to and
+// its running parameters.
+struct BatchRun {
+	std::string output_dir;
+	std::string model;
+	std::vector<std::string> args;
+	int num_iter;
+	int burn_in;
+	int thinning;
+	uint64_t seed;
+};
+
+// Reads a batch manifest: one run per line,
+//
+//   <output_dir> <model> <args...> [num_iter=N] [burn_in=N] [thinning=N] [seed=N]
+//
+// Blank lines and lines starting with '#' are skipped. The running
+// parameters not given on a line are taken from defaults.
+std::vector<BatchRun> ReadManifest(const std::string& filename,
+	const BatchRun& defaults);
+
+// ========================== //
+
+// Runs many models over one graph, loaded once. The runs are handed out one
+// at a time to a pool of workers, longest first, so runs of very different
+// lengths keep every worker busy. Each worker has its own copy of the graph
+// (made up front) and runs its samplers single-threaded, one after another.
+class BatchRunner {
+	public:
+		// Creates the sampler of a run on the given graph, set up with every
+		// option except the output directory
+		typedef std::function<std::unique_ptr<SPPM>(const BatchRun& run,
+			lemon::SmartGraph& graph,
+			lemon::SmartGraph::NodeMap<long long>& node_id,
+			lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute)> Factory;
+
+		BatchRunner(lemon::SmartGraph& graph,
+			lemon::SmartGraph::NodeMap<long long>& node_id,
+			lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute,
+			Factory factory);
+
+		void SetNumThreads(int num_threads);
+
+		// Returns the number of runs that failed (they are logged, and do not
+		// stop the others)
+		int Run(std::vector<BatchRun> runs);
+
+	private:
+		lemon::SmartGraph& m_graph;
+		lemon::SmartGraph::NodeMap<long long>& m_node_id;
+		lemon::SmartGraph::NodeMap<Util::AttrMap>& m_node_attr;
+		Factory m_factory;
+		int m_num_threads;
+};
+
+// ========================== //
+
+#endif // SPPM_BATCH_H_
@@ -0,0 +1,53 @@
+#ifndef SPPM_CSR_GRAPH_H_
+#define SPPM_CSR_GRAPH_H_
+
+#include <vector>
+
+#include <lemon/smart_graph.h>
+
+// ========================== //
+
+// Compressed sparse row adjacency of a graph, by node id. The arcs leaving
+// node u are the slots [Begin(u), End(u)); slot i leads to node Target(i)
+// through the edge with id EdgeId(i). Random walks, which take many steps
+// per iteration, run on this instead of the LEMON incidence lists.
+class CSRGraph {
+	public:
+		explicit CSRGraph(const lemon::SmartGraph& graph) {
+			int num_nodes = graph.maxNodeId() + 1;
+			m_offset.assign(num_nodes + 1, 0);
+			for (lemon::SmartGraph::EdgeIt e(graph); e != lemon::INVALID; ++e) {
+				m_offset[graph.id(graph.u(e)) + 1]++;
+				m_offset[graph.id(graph.v(e)) + 1]++;
+			}
+			for (int u = 0; u < num_nodes; ++u) m_offset[u + 1] += m_offset[u];
+
+			std::vector<int> fill(m_offset.begin(), m_offset.end() - 1);
+			m_target.resize(m_offset.back());
+			m_edge.resize(m_offset.back());
+			for (lemon::SmartGraph::EdgeIt e(graph); e != lemon::INVALID; ++e) {
+				int u = graph.id(graph.u(e));
+				int v = graph.id(graph.v(e));
+				m_target[fill[u]] = v;
+				m_edge[fill[u]++] = graph.id(e);
+				m_target[fill[v]] = u;
+				m_edge[fill[v]++] = graph.id(e);
+			}
+		}
+
+		int NumNodes() const { return m_offset.size() - 1; }
+		int Begin(int u) const { return m_offset[u]; }
+		int End(int u) const { return m_offset[u + 1]; }
+		int Degree(int u) const { return m_offset[u + 1] - m_offset[u]; }
+		int Target(int slot) const { return m_target[slot]; }
+		int EdgeId(int slot) const { return m_edge[slot]; }
+
+	private:
+		std::vector<int> m_offset;
+		std::vector<int> m_target;
+		std::vector<int> m_edge;
+};
+
+// ========================== //
+
+#endif // SPPM_CSR_GRAPH_H_
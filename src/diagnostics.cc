@@ -0,0 +1,236 @@
+#include "diagnostics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+namespace Util {
+
+// ==================================================== //
+
+double EffectiveSampleSize(const vector<double>& x) {
+	size_t n = x.size();
+	if (n < 4) return n;
+
+	double mean = 0.0;
+	for (double xi : x) mean += xi;
+	mean /= n;
+
+	// Autocovariance at a given lag (biased, as the estimator requires)
+	auto autocov = [&](size_t lag) {
+		double sum = 0.0;
+		for (size_t i = 0; i + lag < n; ++i) {
+			sum += (x[i] - mean) * (x[i + lag] - mean);
+		}
+		return sum / n;
+	};
+
+	double var = autocov(0);
+	if (var <= 0.0) return 0.0;
+
+	// Sum the autocorrelations in pairs (lags 2k and 2k+1) while the pair
+	// sums stay positive, forcing them to be non-increasing
+	double tau = -1.0;
+	double previous = 2.0;
+	for (size_t lag = 0; lag + 1 < n; lag += 2) {
+		double pair_sum = (autocov(lag) + autocov(lag + 1)) / var;
+		if (pair_sum <= 0.0) break;
+		pair_sum = min(pair_sum, previous);
+		tau += 2.0 * pair_sum;
+		previous = pair_sum;
+	}
+
+	return n / max(tau, 1.0 / n);
+}
+
+// ==================================================== //
+
+BatchMeans::BatchMeans()
+	: m_shift(0.0), m_count(0), m_batch_size(1),
+	  m_partial_sum(0.0), m_partial_sum_sq(0.0), m_partial_count(0) {
+}
+
+// ========================== //
+
+void BatchMeans::Add(double x) {
+	if (m_count == 0) m_shift = x;
+	x -= m_shift;
+	m_count++;
+	m_partial_sum += x;
+	m_partial_sum_sq += x * x;
+	if (++m_partial_count < m_batch_size) return;
+
+	m_sum.push_back(m_partial_sum);
+	m_sum_sq.push_back(m_partial_sum_sq);
+	m_partial_sum = m_partial_sum_sq = 0.0;
+	m_partial_count = 0;
+
+	// Out of batches: merge them in pairs
+	if (m_sum.size() == static_cast<size_t>(kMaxBatches)) {
+		for (int i = 0; i < kMaxBatches / 2; ++i) {
+			m_sum[i] = m_sum[2 * i] + m_sum[2 * i + 1];
+			m_sum_sq[i] = m_sum_sq[2 * i] + m_sum_sq[2 * i + 1];
+		}
+		m_sum.resize(kMaxBatches / 2);
+		m_sum_sq.resize(kMaxBatches / 2);
+		m_batch_size *= 2;
+	}
+}
+
+// ========================== //
+
+double BatchMeans::Mean() const {
+	if (m_count == 0) return 0.0;
+	double sum = m_partial_sum;
+	for (double s : m_sum) sum += s;
+	return m_shift + sum / m_count;
+}
+
+// ========================== //
+
+double BatchMeans::Variance() const {
+	if (m_count < 2) return 0.0;
+	double sum = m_partial_sum, sum_sq = m_partial_sum_sq;
+	for (size_t i = 0; i < m_sum.size(); ++i) {
+		sum += m_sum[i];
+		sum_sq += m_sum_sq[i];
+	}
+	double mean = sum / m_count;
+	return max(0.0, (sum_sq - m_count * mean * mean) / (m_count - 1));
+}
+
+// ========================== //
+
+double BatchMeans::EffectiveSampleSize() const {
+	size_t num_batches = m_sum.size();
+	if (m_batch_size < 2 || num_batches < 2) return 0.0;
+
+	// Variance of the batch means (the partial batch is left out)
+	double b = m_batch_size;
+	double mean = 0.0;
+	for (double s : m_sum) mean += s / b;
+	mean /= num_batches;
+	double var_means = 0.0;
+	for (double s : m_sum) var_means += (s / b - mean) * (s / b - mean);
+	var_means /= (num_batches - 1);
+
+	// A constant trace (so far) has its mean exactly
+	double variance = Variance();
+	if (variance <= 0.0 || var_means <= 0.0) return m_count;
+	return m_count * variance / (b * var_means);
+}
+
+// ========================== //
+
+void BatchMeans::Half(int half, double* mean, double* variance,
+	size_t* count) const {
+
+	size_t num_batches = m_sum.size() / 2;
+	size_t first = (half == 0) ? 0 : m_sum.size() - num_batches;
+	double sum = 0.0, sum_sq = 0.0;
+	for (size_t i = first; i < first + num_batches; ++i) {
+		sum += m_sum[i];
+		sum_sq += m_sum_sq[i];
+	}
+
+	size_t n = num_batches * m_batch_size;
+	*count = n;
+	*mean = (n > 0) ? m_shift + sum / n : 0.0;
+	*variance = (n > 1) ? max(0.0, (sum_sq - sum * sum / n) / (n - 1)) : 0.0;
+}
+
+// ==================================================== //
+
+ConvergenceMonitor::ConvergenceMonitor(int num_chains,
+	const vector<string>& names)
+
+	: m_names(names),
+	  m_traces(num_chains, vector<BatchMeans>(names.size())) {
+}
+
+// ========================== //
+
+void ConvergenceMonitor::Add(int chain, const vector<double>& values) {
+	for (size_t q = 0; q < values.size(); ++q) m_traces[chain][q].Add(values[q]);
+}
+
+// ========================== //
+
+double ConvergenceMonitor::Mean(int q) const {
+	double sum = 0.0;
+	size_t count = 0;
+	for (const vector<BatchMeans>& chain : m_traces) {
+		sum += chain[q].Mean() * chain[q].Count();
+		count += chain[q].Count();
+	}
+	return count > 0 ? sum / count : 0.0;
+}
+
+// ========================== //
+
+double ConvergenceMonitor::EffectiveSampleSize(int q) const {
+	double ess = 0.0;
+	for (const vector<BatchMeans>& chain : m_traces) {
+		ess += chain[q].EffectiveSampleSize();
+	}
+	return ess;
+}
+
+// ========================== //
+
+double ConvergenceMonitor::SplitRhat(int q) const {
+	// Every chain split in two halves of the same length
+	size_t n = numeric_limits<size_t>::max();
+	vector<double> means, variances;
+	for (const vector<BatchMeans>& chain : m_traces) {
+		for (int half = 0; half < 2; ++half) {
+			double mean, variance;
+			size_t count;
+			chain[q].Half(half, &mean, &variance, &count);
+			means.push_back(mean);
+			variances.push_back(variance);
+			n = min(n, count);
+		}
+	}
+	if (n < 2) return numeric_limits<double>::infinity();
+
+	double within = 0.0, grand_mean = 0.0;
+	for (size_t j = 0; j < means.size(); ++j) {
+		within += variances[j];
+		grand_mean += means[j];
+	}
+	within /= means.size();
+	grand_mean /= means.size();
+	double between = 0.0;
+	for (double mean : means) between += (mean - grand_mean) * (mean - grand_mean);
+	between *= static_cast<double>(n) / (means.size() - 1);
+
+	// A quantity that never changed has converged trivially
+	if (within <= 0.0) {
+		return (between <= 0.0) ? 1.0 : numeric_limits<double>::infinity();
+	}
+	double var_plus = (n - 1.0) / n * within + between / n;
+	return sqrt(var_plus / within);
+}
+
+// ========================== //
+
+double ConvergenceMonitor::MinEffectiveSampleSize() const {
+	double ess = numeric_limits<double>::infinity();
+	for (int q = 0; q < NumQuantities(); ++q) ess = min(ess, EffectiveSampleSize(q));
+	return ess;
+}
+
+// ========================== //
+
+double ConvergenceMonitor::MaxSplitRhat() const {
+	double rhat = 0.0;
+	for (int q = 0; q < NumQuantities(); ++q) rhat = max(rhat, SplitRhat(q));
+	return rhat;
+}
+
+// ==================================================== //
+
+};
@@ -0,0 +1,88 @@
+#ifndef SPPM_DIAGNOSTICS_H_
+#define SPPM_DIAGNOSTICS_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Util {
+
+// ==================================================== //
+// Convergence diagnostics for scalar traces of the chain
+// ==================================================== //
+
+// Effective sample size of a trace, by Geyer's initial monotone sequence
+// estimator of the autocorrelation time. A constant trace has none.
+double EffectiveSampleSize(const std::vector<double>& x);
+
+// ========================== //
+
+// Batch means of a scalar trace, updated online in constant memory. The trace
+// is cut into batches of equal size; when there are kMaxBatches of them,
+// adjacent ones are merged and the batch size doubles. The variance of the
+// batch means gives the asymptotic variance of the mean, hence the ESS.
+class BatchMeans {
+	public:
+		static const int kMaxBatches = 64;
+
+		BatchMeans();
+
+		void Add(double x);
+
+		size_t Count() const { return m_count; }
+		double Mean() const;
+		double Variance() const;
+
+		// Zero until there are batches of at least two values. A constant
+		// trace counts as independent draws.
+		double EffectiveSampleSize() const;
+
+		// Mean and variance of the first (0) or second (1) half of the
+		// trace, both made of the same number of whole batches
+		void Half(int half, double* mean, double* variance, size_t* count) const;
+
+	private:
+		// Values are stored shifted by the first one, against cancellation
+		double m_shift;
+		size_t m_count;
+		size_t m_batch_size;
+		std::vector<double> m_sum;
+		std::vector<double> m_sum_sq;
+		double m_partial_sum;
+		double m_partial_sum_sq;
+		size_t m_partial_count;
+};
+
+// ========================== //
+
+// Online ESS and split-R-hat of a few named quantities over one or more
+// chains of the same target. The ESS of a quantity is the sum over chains;
+// split-R-hat compares the halves of every chain (Gelman et al. 2013).
+class ConvergenceMonitor {
+	public:
+		ConvergenceMonitor(int num_chains, const std::vector<std::string>& names);
+
+		// values[q] is the current value of quantity q in the chain
+		void Add(int chain, const std::vector<double>& values);
+
+		int NumQuantities() const { return m_names.size(); }
+		const std::string& Name(int q) const { return m_names[q]; }
+
+		// Mean over all the chains
+		double Mean(int q) const;
+		double EffectiveSampleSize(int q) const;
+		double SplitRhat(int q) const;
+
+		double MinEffectiveSampleSize() const;
+		double MaxSplitRhat() const;
+
+	private:
+		std::vector<std::string> m_names;
+		std::vector<std::vector<BatchMeans>> m_traces;
+};
+
+// ==================================================== //
+
+};
+
+#endif // SPPM_DIAGNOSTICS_H_
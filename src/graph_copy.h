@@ -0,0 +1,38 @@
+#ifndef SPPM_GRAPH_COPY_H_
+#define SPPM_GRAPH_COPY_H_
+
+#include <lemon/smart_graph.h>
+
+#include "util.h"
+
+// ========================== //
+
+// A copy of the input graph and its node data, for a sampler that runs
+// alongside others (LEMON maps can not be created on one graph from several
+// threads). Nodes and edges are added in id order, so the copy has the same
+// ids.
+struct GraphCopy {
+	lemon::SmartGraph graph;
+	lemon::SmartGraph::NodeMap<long long> node_id;
+	lemon::SmartGraph::NodeMap<Util::AttrMap> node_attribute;
+
+	GraphCopy(const lemon::SmartGraph& from,
+		const lemon::SmartGraph::NodeMap<long long>& from_id,
+		const lemon::SmartGraph::NodeMap<Util::AttrMap>& from_attribute)
+			: node_id(graph), node_attribute(graph) {
+		for (int id = 0; id <= from.maxNodeId(); ++id) {
+			lemon::SmartGraph::Node u = graph.addNode();
+			node_id[u] = from_id[from.nodeFromId(id)];
+			node_attribute[u] = from_attribute[from.nodeFromId(id)];
+		}
+		for (int id = 0; id <= from.maxEdgeId(); ++id) {
+			lemon::SmartGraph::Edge e = from.edgeFromId(id);
+			graph.addEdge(graph.nodeFromId(from.id(from.u(e))),
+				graph.nodeFromId(from.id(from.v(e))));
+		}
+	}
+};
+
+// ========================== //
+
+#endif // SPPM_GRAPH_COPY_H_
@@ -0,0 +1,25 @@
+#ifndef SPPM_LOG_H_
+#define SPPM_LOG_H_
+
+#include "easylogging++.h"
+
+// ==================================================== //
+// The samplers never log through the default logger of the program. The
+// library logs through the "sppm" logger, and each sampler through the
+// logger it was built with (SPPM_LOGGER unless given another one: the
+// embedding API gives each of its samplers a logger of its own). A program
+// running the samplers directly registers SPPM_LOGGER before configuring
+// its loggers, so the configuration also applies to it.
+// ==================================================== //
+
+#define SPPM_LOGGER "sppm"
+
+// Log of the library
+#define SPPM_LOG(LEVEL) CLOG(LEVEL, SPPM_LOGGER)
+
+// Log of a sampler, in the members of SPPM and its models
+#define SAMPLER_LOG(LEVEL) CLOG(LEVEL, LoggerId())
+#define SAMPLER_VLOG(vlevel) CVLOG(vlevel, LoggerId())
+#define SAMPLER_VLOG_EVERY_N(n, vlevel) CVLOG_EVERY_N(n, vlevel, LoggerId())
+
+#endif // SPPM_LOG_H_
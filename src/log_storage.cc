@@ -0,0 +1,11 @@
+// The Easylogging++ storage of programs linking libsppm that do not define
+// their own with INITIALIZE_EASYLOGGINGPP. A member of a static library is
+// only linked in when something needs it, so a program that does define the
+// storage (like the sppm tools) keeps its own and this file is left out.
+// The library does not install the crash handler of Easylogging++ in the
+// program.
+
+#define ELPP_DISABLE_DEFAULT_CRASH_HANDLING
+#include "easylogging++.h"
+
+INITIALIZE_EASYLOGGINGPP
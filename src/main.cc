@@ -15,16 +15,29 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
    */
 
+#include <memory>
+#include <random>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
-#include "easylogging++.h"
+#include "log.h"
 #include <gflags/gflags.h>
 #include <lemon/smart_graph.h>
 
+#include "batch.h"
 #include "geojson_reader.h"
+#include "graph_copy.h"
+#include "map_search.h"
+#include "masked_moments.h"
+#include "profiler.h"
+#include "sample_sink.h"
+#include "trace.h"
 #include "sppm_normal.h"
 #include "sppm_poisson.h"
+#include "space_time.h"
+#include "tempering.h"
 #include "util.h"
 
 using namespace std;
@@ -35,20 +48,299 @@ DEFINE_uint64(num_iter, 1000, "number of iterations to run");
 DEFINE_uint64(burn_in, 100, "burn-in period");
 DEFINE_uint64(thinning, 10, "thinning. Take only each i-th sampled value");
 DEFINE_uint64(verbose, 9, "verbose level");
+DEFINE_uint64(num_threads, 1, "number of threads used to sweep the connected "
+	"components of the graph (batch: number of runs at a time)");
+DEFINE_uint64(seed, 0, "random seed. Runs with the same seed (and chain) give "
+	"the same samples, whatever the number of threads. 0 picks a random one");
+DEFINE_uint64(chain, 0, "chain id, to run independent chains with one seed");
+DEFINE_string(tree_sampler, "kruskal", "how spanning trees are drawn: 'kruskal' "
+	"(minimum spanning tree of random weights) or 'wilson' (uniform spanning "
+	"trees by loop-erased random walks)");
+DEFINE_double(split_merge_rate, 0, "expected number of split-merge proposals "
+	"per iteration, interleaved with the edge sweep. 0 disables them");
+DEFINE_uint64(replicas, 1, "number of tempered replicas (parallel tempering, "
+	"one thread each). 1 runs the plain sampler");
+DEFINE_uint64(swap_interval, 10, "iterations between replica swap proposals");
+DEFINE_double(min_beta, 0.1, "inverse temperature of the hottest replica");
+DEFINE_double(target_ess, 0, "stop once the number of groups, rho and the log "
+	"posterior reach this effective sample size (and split-R-hat < 1.01). "
+	"0 runs all the iterations");
+DEFINE_double(max_seconds, 0, "stop after this many seconds of sampling. "
+	"0 means no limit");
+DEFINE_uint64(init_groups, 0, "start from this many groups, cutting a minimum "
+	"spanning tree on attribute dissimilarity (or --init_tree) greedily by the "
+	"model's predictive. 0 starts from singletons");
+DEFINE_string(init_partition, "", "start from the last partition of this file "
+	"(pi.csv format)");
+DEFINE_string(init_tree, "", "start from the last tree of this file (tree.csv "
+	"format)");
+DEFINE_string(warm_start, "", "directory with the output files of a previous "
+	"run on the same map: continue from its final state (with new attribute "
+	"values) and log how far the posterior moved. The default burn-in is cut "
+	"to a tenth");
+DEFINE_uint64(restarts, 16, "map: number of random restarts of the greedy "
+	"search, run in parallel on the available cores");
+DEFINE_uint64(map_rounds, 100, "map: maximum number of rounds (tree redraw and "
+	"greedy sweep) per restart");
+DEFINE_uint64(periods, 1, "space-time: number of periods. Above 1 the samplers "
+	"partition the product of the map with the periods, and each attribute "
+	"<attr> is read as <attr>_1 .. <attr>_T");
+DEFINE_string(profile, "", "time the phases of the sampler and write a JSON "
+	"report (calls, total time and percentiles per phase) to this file");
+DEFINE_double(progress_interval, 5, "seconds between progress reports "
+	"(iterations per second, number of groups, rho and time left); 0 turns "
+	"them off");
+DEFINE_string(metrics_file, "", "also append the progress reports to this "
+	"file in the output directory, one JSON object per line");
+DEFINE_string(prometheus_file, "", "also rewrite this file with each progress "
+	"report, in the Prometheus text format (for the node_exporter textfile "
+	"collector). Turns on the phase timers of --profile");
+DEFINE_string(trace, "", "record the trace events of the sampler and write "
+	"them to this file, to be decoded by sppm_trace (needs a build with "
+	"SPPM_TRACE)");
+DEFINE_uint64(trace_sample, 1, "trace: record every n-th event of each kind");
+DEFINE_uint64(trace_buffer, 65536, "trace: number of events kept per thread "
+	"(the most recent ones)");
+DEFINE_string(kernel, "", "kernel of the group statistics: 'scalar', 'avx2' "
+	"or 'avx512' (by default the SPPM_KERNEL environment variable, or the "
+	"widest one this CPU supports). Seeded runs give the same samples on "
+	"different machines only with the same kernel, e.g. 'scalar'");
+DEFINE_string(sinks, "csv", "where the held samples go, a comma separated "
+	"list of: 'csv' (pi.csv, tree.csv, rho.csv and a file per parameter), "
+	"'binary' (samples.bin), 'summary' (posterior means in summary.csv and "
+	"summary_stats.csv) and 'null' (nothing)");
 //DEFINE_string(output_dir, ".", "directory where the output CSV files will "
 	//"be saved");
 
 static const char USAGE[] =
 R"(
 Usage:
-	sppm [options] [--] normal <GeoJSON> <attr> <r> <s> <m> <v> <a> <b>
-	sppm [options] [--] poisson <GeoJSON> <attr_Yi> <attr_Ei> <r> <s> <a> <b>
+	sppm [options] [--] [map] normal <GeoJSON> <attr> <r> <s> <m> <v> <a> <b>
+	sppm [options] [--] [map] poisson <GeoJSON> <attr_Yi> <attr_Ei> <r> <s> <a> <b>
+	sppm [options] [--] batch <GeoJSON> <manifest>
+
+With 'map', the best partition found by a greedy search is written to map.csv
+instead of sampling from the posterior.
+
+A batch manifest has one run per line: its output directory, then the model
+and its arguments as above (without the GeoJSON file), then optionally any of
+num_iter=N burn_in=N thinning=N seed=N.
 )";
 
 INITIALIZE_EASYLOGGINGPP
 
 // ========================== //
 
+// Number of arguments of each model after the GeoJSON file (-1 if unknown)
+static int NumModelArgs(const string& model) {
+	if (model == "normal") return 7;
+	if (model == "poisson") return 6;
+	return -1;
+}
+
+// ========================== //
+
+// The options shared by every model
+static void SetUpSampler(SPPM& sppm, int num_threads, uint64_t seed) {
+	SPPM::TreeSampler tree_sampler = (FLAGS_tree_sampler == "wilson")
+		? SPPM::kTreeWilson : SPPM::kTreeKruskal;
+	sppm.SetNumThreads(num_threads);
+	sppm.SetSeed(seed, FLAGS_chain);
+	sppm.SetSplitMergeRate(FLAGS_split_merge_rate);
+	sppm.SetTreeSampler(tree_sampler);
+	sppm.SetStoppingRule(FLAGS_target_ess, FLAGS_max_seconds);
+	sppm.SetInitialGroups(FLAGS_init_groups);
+	sppm.SetInitialFiles(FLAGS_init_partition, FLAGS_init_tree);
+	if (!FLAGS_warm_start.empty()) sppm.SetWarmStart(FLAGS_warm_start);
+	sppm.SetProgress(FLAGS_progress_interval, FLAGS_metrics_file);
+	sppm.SetPrometheusFile(FLAGS_prometheus_file);
+	sppm.SetSampleSinks(FLAGS_sinks);
+}
+
+// ========================== //
+
+// Creates and sets up a sampler of a model, given its arguments. On a
+// space-time product the attributes come from the regions (space_time).
+static unique_ptr<SPPM> CreateModel(const string& model,
+	const vector<string>& args, lemon::SmartGraph& graph,
+	lemon::SmartGraph::NodeMap<long long>& node_id,
+	lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute,
+	const SpaceTime* space_time, int num_threads, uint64_t seed) {
+
+	// Run the normal case
+	if (model == "normal") {
+
+		// Parse the arguments
+		string attr = args[0];
+		double r = stod(args[1]);
+		double s = stod(args[2]);
+		double m = stod(args[3]);
+		double v = stod(args[4]);
+		double a = stod(args[5]);
+		double b = stod(args[6]);
+
+		// Set up the algorithm with the given parameters
+		LOG(INFO) << "Using attribute: Yi = "+ attr;
+		SPPM_Normal* sppm = new SPPM_Normal(graph, node_id, node_attribute);
+		unique_ptr<SPPM> result(sppm);
+		sppm->SetRhoParameters(r, s);
+		SetUpSampler(*sppm, num_threads, seed);
+		//sppm->SetRhoParameters(2, 850);
+		//sppm->SetRhoParameters(5, 5500);
+		//sppm->SetRhoParameters(1000, 1100000);
+		//sppm->SetRhoParameters(52, 5450);
+		//sppm->SetNormalGammaParameters(40, 0.1, 0.65, 0.04);
+		//sppm->SetNormalGammaParameters(100, 1, 0.65, 0.04);
+		//sppm->SetNormalGammaParameters(400, 1, 0.65, 0.04);
+		//sppm->SetNormalGammaParameters(400, 1, 0.65, 0.04);
+		//sppm->SetNormalGammaParameters(1600, 1, 0.65, 0.01);
+		//sppm->SetNormalGammaParameters(40000, 49, 0.65, 0.0196);
+		//sppm->SetNormalGammaParameters(10000, 64, 0.65, 0.01024);
+		sppm->SetNormalGammaParameters(a, b, m, v);
+		if (space_time) sppm->SetAttributeColumn(space_time->Column(attr));
+		else sppm->SetAttribute(attr);
+		return result;
+	}
+
+	// Run the poisson case
+	string attr_Yi = args[0];
+	string attr_Ei = args[1];
+	double r = stod(args[2]);
+	double s = stod(args[3]);
+	double a = stod(args[4]);
+	double b = stod(args[5]);
+
+	LOG(INFO) << "Using attributes: Yi = "+ attr_Yi + ", Ei = " + attr_Ei;
+	SPPM_Poisson* sppm = new SPPM_Poisson(graph, node_id, node_attribute);
+	unique_ptr<SPPM> result(sppm);
+	sppm->SetRhoParameters(r, s);
+	SetUpSampler(*sppm, num_threads, seed);
+	sppm->SetGammaParameters(a, b);
+	if (space_time) {
+		sppm->SetAttributeColumns(space_time->Column(attr_Yi),
+			space_time->Column(attr_Ei));
+	}
+	else {
+		sppm->SetAttributes(attr_Yi, attr_Ei);
+	}
+	return result;
+}
+
+// ========================== //
+
+// Creates the sampler of every replica (or MAP search worker): the first on
+// the input graph, the others on copies of it
+static vector<unique_ptr<SPPM>> CreateReplicas(const string& model,
+	const vector<string>& args, lemon::SmartGraph& graph,
+	lemon::SmartGraph::NodeMap<long long>& node_id,
+	lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute,
+	vector<unique_ptr<GraphCopy>>& copies, size_t count,
+	const SpaceTime* space_time, int num_threads, uint64_t seed) {
+
+	vector<unique_ptr<SPPM>> replicas;
+	replicas.push_back(CreateModel(model, args, graph, node_id, node_attribute,
+		space_time, num_threads, seed));
+	for (size_t k = 1; k < count; ++k) {
+		copies.emplace_back(new GraphCopy(graph, node_id, node_attribute));
+		GraphCopy& copy = *copies.back();
+		replicas.push_back(CreateModel(model, args, copy.graph, copy.node_id,
+			copy.node_attribute, space_time, num_threads, seed));
+	}
+	return replicas;
+}
+
+// ========================== //
+
+static void RunChains(vector<unique_ptr<SPPM>>& replicas, int num_iter,
+	int burn_in, int steps, uint64_t seed) {
+
+	if (replicas.size() == 1) {
+		replicas[0]->Run(num_iter, burn_in, steps);
+		return;
+	}
+
+	ParallelTempering tempering(replicas, FLAGS_min_beta);
+	tempering.SetSwapInterval(FLAGS_swap_interval);
+	tempering.SetSeed(seed, FLAGS_chain);
+	tempering.Run(num_iter, burn_in, steps);
+}
+
+// ========================== //
+
+// Number of samplers to create: the replicas, or one MAP search worker per
+// core (but no more than the restarts)
+static size_t NumWorkers(bool map_search) {
+	if (!map_search) return FLAGS_replicas;
+	size_t cores = max(thread::hardware_concurrency(), 1u);
+	return min<size_t>(cores, max<uint64_t>(FLAGS_restarts, 1));
+}
+
+// ========================== //
+
+static void RunSearch(vector<unique_ptr<SPPM>>& workers) {
+	MapSearch search(workers);
+	search.SetRestarts(FLAGS_restarts);
+	search.SetMaxRounds(FLAGS_map_rounds);
+	search.Run("map.csv");
+}
+
+// ========================== //
+
+// Runs every model of a manifest on the loaded graph. Returns the number of
+// failed runs.
+static int RunBatch(const string& manifest, lemon::SmartGraph& graph,
+	lemon::SmartGraph::NodeMap<long long>& node_id,
+	lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute,
+	const SpaceTime* space_time, int num_threads, uint64_t seed) {
+
+	BatchRun defaults;
+	defaults.num_iter = FLAGS_num_iter;
+	defaults.burn_in = FLAGS_burn_in;
+	defaults.thinning = FLAGS_thinning;
+	defaults.seed = seed;
+	vector<BatchRun> runs = ReadManifest(manifest, defaults);
+	for (const BatchRun& run : runs) {
+		if (NumModelArgs(run.model) != static_cast<int>(run.args.size())) {
+			throw std::invalid_argument("Invalid model in manifest: " + run.output_dir);
+		}
+	}
+
+	// Each run is single-threaded; the threads run several at a time
+	BatchRunner runner(graph, node_id, node_attribute, [=](const BatchRun& run,
+		lemon::SmartGraph& graph, lemon::SmartGraph::NodeMap<long long>& node_id,
+		lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute) {
+		return CreateModel(run.model, run.args, graph, node_id, node_attribute,
+			space_time, 1, run.seed);
+	});
+	runner.SetNumThreads(num_threads);
+	return runner.Run(runs);
+}
+
+// ========================== //
+
+// Reads the map. With several periods its space-time product is built in
+// product, and space_time gives the attributes of the product nodes.
+static void LoadGraph(const string& input_file, lemon::SmartGraph& graph,
+	lemon::SmartGraph::NodeMap<long long>& node_id,
+	lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute,
+	lemon::SmartGraph& product, lemon::SmartGraph::NodeMap<long long>& product_id,
+	unique_ptr<SpaceTime>& space_time) {
+
+	Util::ScopedTimer timer(Util::kPhaseLoad);
+	GeoJSONReader reader;
+	bool ok = reader.LoadData(input_file, graph, node_id, node_attribute);
+	if (!ok) {
+		LOG(FATAL) << "Failed to load data from file: " << input_file;
+	}
+	if (FLAGS_periods > 1) {
+		space_time.reset(new SpaceTime(graph, node_id, node_attribute, FLAGS_periods));
+		space_time->Build(product, product_id);
+		space_time->WriteIndex("spacetime.csv");
+	}
+}
+
+// ========================== //
+
 int main(int argc, char* argv[])
 {
 	//START_EASYLOGGINGPP(argc, argv);
@@ -56,7 +348,8 @@ int main(int argc, char* argv[])
 	gflags::SetVersionString("Spatial PPM Version 1.0");
 	gflags::ParseCommandLineFlags(&argc, &argv, true);
 
-	// Load logger configuration
+	// Load logger configuration (for the samplers' logger too)
+	el::Loggers::getLogger(SPPM_LOGGER);
 	el::Configurations defaultConf;
 	defaultConf.set(el::Level::Verbose, el::ConfigurationType::ToStandardOutput, "false");
 	el::Loggers::reconfigureAllLoggers(defaultConf);
@@ -71,78 +364,121 @@ int main(int argc, char* argv[])
 	int num_iter = FLAGS_num_iter;
 	int burn_in = FLAGS_burn_in;
 	int steps = FLAGS_thinning;
+	int num_threads = FLAGS_num_threads;
+	uint64_t seed = FLAGS_seed;
+	if (FLAGS_tree_sampler != "kruskal" && FLAGS_tree_sampler != "wilson") {
+		cerr << "Invalid tree sampler: " << FLAGS_tree_sampler << endl;
+		return 1;
+	}
+	if (FLAGS_progress_interval < 0) {
+		cerr << "Invalid progress interval: " << FLAGS_progress_interval << endl;
+		return 1;
+	}
+	if (!FLAGS_prometheus_file.empty() && FLAGS_progress_interval == 0) {
+		cerr << "The Prometheus file is written with the progress reports; "
+			"set a progress interval" << endl;
+		return 1;
+	}
+	if (!FLAGS_kernel.empty() && !Util::SetMaskedMomentsKernel(FLAGS_kernel)) {
+		cerr << "Kernel not supported on this machine: " << FLAGS_kernel << endl;
+		return 1;
+	}
+	if (!Util::ValidSinkNames(FLAGS_sinks)) {
+		cerr << "Invalid sample sinks: " << FLAGS_sinks << endl;
+		return 1;
+	}
+#ifndef SPPM_TRACE
+	if (!FLAGS_trace.empty()) {
+		cerr << "Tracing needs a build with SPPM_TRACE (cmake -DSPPM_TRACE=ON)" << endl;
+		return 1;
+	}
+#endif
+	if (FLAGS_replicas < 1 || FLAGS_replicas > 256) {
+		cerr << "Invalid number of replicas: " << FLAGS_replicas << endl;
+		return 1;
+	}
+	if (seed == 0) {
+		random_device device;
+		seed = (static_cast<uint64_t>(device()) << 32) | device();
+	}
+
+	if (!FLAGS_warm_start.empty()) {
+		if (!FLAGS_init_partition.empty() || !FLAGS_init_tree.empty()) {
+			cerr << "A warm start can not take an initial partition or tree" << endl;
+			return 1;
+		}
+		// The chain starts close to the new posterior
+		if (gflags::GetCommandLineFlagInfoOrDie("burn_in").is_default) {
+			burn_in /= 10;
+		}
+	}
+
+	// The map subcommand searches the mode of the same model
+	bool map_search = argc > 1 && string(argv[1]) == "map";
+	if (map_search) {
+		argv[1] = argv[0];
+		argc--;
+		argv++;
+	}
+	size_t num_workers = NumWorkers(map_search);
+	if (!FLAGS_profile.empty() || !FLAGS_prometheus_file.empty()) {
+		Util::Profiler::Enable();
+	}
+	if (!FLAGS_trace.empty()) {
+		Util::Trace::Enable(FLAGS_trace_buffer, FLAGS_trace_sample);
+	}
 
 	try {
 		lemon::SmartGraph graph;
 		lemon::SmartGraph::NodeMap<long long> node_id(graph);
 		lemon::SmartGraph::NodeMap<Util::AttrMap> node_attribute(graph);
 
-		// Run the normal case
-		if (argc == 10 && string(argv[1]) == "normal") {
-
-			// Parse the arguments
-			string input_file = argv[2];
-			string attr = argv[3];
-			double r = stod(argv[4]);
-			double s = stod(argv[5]);
-			double m = stod(argv[6]);
-			double v = stod(argv[7]);
-			double a = stod(argv[8]);
-			double b = stod(argv[9]);
+		// The space-time product, if any, is what the samplers run on
+		lemon::SmartGraph product;
+		lemon::SmartGraph::NodeMap<long long> product_id(product);
+		lemon::SmartGraph::NodeMap<Util::AttrMap> product_attribute(product);
+		unique_ptr<SpaceTime> space_time;
 
-			// Read the data
-			GeoJSONReader reader;
-			bool ok = reader.LoadData(input_file, graph, node_id, node_attribute);
-			if (!ok) {
-				LOG(FATAL) << "Failed to load data from file: " << input_file;
+		// Run a batch of models
+		if (argc == 4 && string(argv[1]) == "batch" && !map_search) {
+			if (FLAGS_replicas > 1) {
+				cerr << "Batch runs can not be tempered" << endl;
+				return 1;
 			}
+			string input_file = argv[2];
+			string manifest = argv[3];
 
-			// Set up the algorithm with the given parameters
-			LOG(INFO) << "Using attribute: Yi = "+ attr;
-			SPPM_Normal sppm(graph, node_id, node_attribute);
-			sppm.SetRhoParameters(r, s);
-			//sppm.SetRhoParameters(2, 850);
-			//sppm.SetRhoParameters(5, 5500);
-			//sppm.SetRhoParameters(1000, 1100000);
-			//sppm.SetRhoParameters(52, 5450);
-			//sppm.SetNormalGammaParameters(40, 0.1, 0.65, 0.04);
-			//sppm.SetNormalGammaParameters(100, 1, 0.65, 0.04);
-			//sppm.SetNormalGammaParameters(400, 1, 0.65, 0.04);
-			//sppm.SetNormalGammaParameters(400, 1, 0.65, 0.04);
-			//sppm.SetNormalGammaParameters(1600, 1, 0.65, 0.01);
-			//sppm.SetNormalGammaParameters(40000, 49, 0.65, 0.0196);
-			//sppm.SetNormalGammaParameters(10000, 64, 0.65, 0.01024);
-			sppm.SetNormalGammaParameters(a, b, m, v);
-			sppm.SetAttribute(attr);
-
-			// Run the algorithm
-			sppm.Run(num_iter, burn_in, steps);
+			// Read the data, once for all the runs
+			LoadGraph(input_file, graph, node_id, node_attribute, product,
+				product_id, space_time);
+			int failed = space_time
+				? RunBatch(manifest, product, product_id, product_attribute,
+					space_time.get(), num_threads, seed)
+				: RunBatch(manifest, graph, node_id, node_attribute, nullptr,
+					num_threads, seed);
+			if (failed > 0) return 1;
 
-		// Run the poisson case
-		} else if (argc == 9 && string(argv[1]) == "poisson") {
+		// Run the normal or poisson case
+		} else if (argc >= 3 && NumModelArgs(argv[1]) == argc - 3) {
+			string model = argv[1];
 			string input_file = argv[2];
-			string attr_Yi = argv[3];
-			string attr_Ei = argv[4];
-			double r = stod(argv[5]);
-			double s = stod(argv[6]);
-			double a = stod(argv[7]);
-			double b = stod(argv[8]);
+			vector<string> args(argv + 3, argv + argc);
 
 			// Read the data
-			GeoJSONReader reader;
-			bool ok = reader.LoadData(input_file, graph, node_id, node_attribute);
-			if (!ok) {
-				LOG(FATAL) << "Failed to load data from file: " << input_file;
-			}
+			LoadGraph(input_file, graph, node_id, node_attribute, product,
+				product_id, space_time);
 
-			LOG(INFO) << "Using attributes: Yi = "+ attr_Yi + ", Ei = " + attr_Ei;
-			SPPM_Poisson sppm(graph, node_id, node_attribute);
-			sppm.SetRhoParameters(r, s);
-			sppm.SetGammaParameters(a, b);
-			sppm.SetAttributes(attr_Yi, attr_Ei);
+			// Set up the algorithm with the given parameters
+			vector<unique_ptr<GraphCopy>> copies;
+			vector<unique_ptr<SPPM>> replicas = space_time
+				? CreateReplicas(model, args, product, product_id, product_attribute,
+					copies, num_workers, space_time.get(), num_threads, seed)
+				: CreateReplicas(model, args, graph, node_id, node_attribute,
+					copies, num_workers, nullptr, num_threads, seed);
 
 			// Run the algorithm
-			sppm.Run(num_iter, burn_in, steps);
+			if (map_search) RunSearch(replicas);
+			else RunChains(replicas, num_iter, burn_in, steps, seed);
 
 		// Invalid case
 		} else {
@@ -150,6 +486,15 @@ int main(int argc, char* argv[])
 			cerr << USAGE << endl;
 			return 1;
 		}
+
+		if (!FLAGS_profile.empty()) {
+			Util::Profiler::WriteReport(FLAGS_profile);
+			LOG(INFO) << "== Profile written to " << FLAGS_profile;
+		}
+		if (!FLAGS_trace.empty()) {
+			Util::Trace::Dump(FLAGS_trace);
+			LOG(INFO) << "== Trace written to " << FLAGS_trace;
+		}
 	} catch (const char* e) {
 		LOG(FATAL) << "Exception caught: " << e;
 	} catch (std::invalid_argument) {
@@ -0,0 +1,72 @@
+#include "map_search.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+#include "easylogging++.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// ==================================================== //
+
+MapSearch::MapSearch(vector<unique_ptr<SPPM>>& workers)
+	: m_workers(workers), m_num_restarts(16), m_max_rounds(100) {
+
+	if (m_workers.empty()) {
+		throw std::invalid_argument("MAP search needs a worker.");
+	}
+}
+
+// ========================== //
+
+void MapSearch::SetRestarts(int num_restarts) {
+	LOG(INFO) << "== MAP search restarts: " << num_restarts;
+	m_num_restarts = max(num_restarts, 1);
+}
+
+// ========================== //
+
+void MapSearch::SetMaxRounds(int max_rounds) {
+	LOG(INFO) << "== MAP search rounds per restart: at most " << max_rounds;
+	m_max_rounds = max(max_rounds, 1);
+}
+
+// ========================== //
+
+double MapSearch::Run(const string& filename) {
+	int num_workers = m_workers.size();
+	LOG(INFO) << "== Running " << m_num_restarts << " MAP restarts on "
+		<< num_workers << " thread(s)";
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	// Restarts are handed out one at a time, as they can take very different
+	// numbers of rounds
+	atomic<int> next(0);
+	ThreadPool pool(num_workers);
+	pool.ParallelFor(num_workers, [&](int k) {
+		for (int r = next++; r < m_num_restarts; r = next++) {
+			m_workers[k]->GreedySearch(r, m_max_rounds);
+		}
+	});
+
+	// Ties go to the first restart, whatever the number of workers
+	SPPM* best = m_workers[0].get();
+	for (const unique_ptr<SPPM>& worker : m_workers) {
+		if (worker->BestRestart() < 0) continue;
+		if (best->BestRestart() < 0 || worker->BestScore() > best->BestScore()
+			|| (worker->BestScore() == best->BestScore()
+				&& worker->BestRestart() < best->BestRestart())) {
+			best = worker.get();
+		}
+	}
+
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+	LOG(INFO) << "== Best log posterior: " << best->BestScore()
+		<< " (restart " << best->BestRestart() << ", " << elapsed.count() << "s)";
+	best->WriteBestPartition(filename);
+	return best->BestScore();
+}
+
+// ==================================================== //
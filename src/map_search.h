@@ -0,0 +1,39 @@
+#ifndef SPPM_MAP_SEARCH_H_
+#define SPPM_MAP_SEARCH_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sppm.h"
+
+// ========================== //
+
+// Maximum a posteriori partition by greedy ascent with random restarts. Each
+// restart starts from a new random tree and alternates greedy sweeps over
+// the tree edges (the sampler's sweep, taking the more probable state of
+// each edge) with redrawing the tree given the partition. The restarts are
+// spread over the workers, one thread each, and the best partition found is
+// written in the format of pi.csv.
+class MapSearch {
+	public:
+		// All workers must be samplers of the same model, on the same graph
+		// (or copies of it) and with the same parameters and seed
+		explicit MapSearch(std::vector<std::unique_ptr<SPPM>>& workers);
+
+		void SetRestarts(int num_restarts);
+		void SetMaxRounds(int max_rounds);
+
+		// Returns the score (log posterior, rho and theta integrated out)
+		// of the best partition
+		double Run(const std::string& filename);
+
+	private:
+		std::vector<std::unique_ptr<SPPM>>& m_workers;
+		int m_num_restarts;
+		int m_max_rounds;
+};
+
+// ========================== //
+
+#endif // SPPM_MAP_SEARCH_H_
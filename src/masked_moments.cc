@@ -0,0 +1,216 @@
+#include "masked_moments.h"
+
+#include <cstdlib>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SPPM_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace Util {
+
+// ==================================================== //
+
+// Adds the selected entries of one 64-entry block, one set bit at a time
+static inline void AddBits(uint64_t bits, const double* y, Moments* m) {
+	m->count += __builtin_popcountll(bits);
+	while (bits) {
+		double yi = y[__builtin_ctzll(bits)];
+		m->sum += yi;
+		m->sum_sq += yi * yi;
+		bits &= bits - 1;
+	}
+}
+
+// ========================== //
+
+static void MaskedMomentsScalar(const uint64_t* mask_u, const uint64_t* mask_v,
+	const double* y, size_t n, Moments* u, Moments* v) {
+
+	size_t num_words = (n + 63) / 64;
+	for (size_t w = 0; w < num_words; ++w) {
+		// Bits past n are never set, so the last block needs no special case
+		AddBits(mask_u[w], y + 64 * w, u);
+		AddBits(mask_v[w], y + 64 * w, v);
+	}
+}
+
+// ==================================================== //
+
+#ifdef SPPM_X86_KERNELS
+
+static inline double HorizontalSum(__m256d x) __attribute__((target("avx2")));
+static inline double HorizontalSum(__m256d x) {
+	__m128d low = _mm256_castpd256_pd128(x);
+	__m128d high = _mm256_extractf128_pd(x, 1);
+	low = _mm_add_pd(low, high);
+	return _mm_cvtsd_f64(_mm_add_sd(low, _mm_unpackhi_pd(low, low)));
+}
+
+// ========================== //
+
+__attribute__((target("avx2")))
+static void MaskedMomentsAVX2(const uint64_t* mask_u, const uint64_t* mask_v,
+	const double* y, size_t n, Moments* u, Moments* v) {
+
+	const __m256i lane_bits = _mm256_set_epi64x(8, 4, 2, 1);
+	__m256d sum_u = _mm256_setzero_pd(), sum_sq_u = _mm256_setzero_pd();
+	__m256d sum_v = _mm256_setzero_pd(), sum_sq_v = _mm256_setzero_pd();
+
+	size_t full_words = n / 64;
+	for (size_t w = 0; w < full_words; ++w) {
+		uint64_t bits_u = mask_u[w];
+		uint64_t bits_v = mask_v[w];
+		if ((bits_u | bits_v) == 0) continue;
+		u->count += __builtin_popcountll(bits_u);
+		v->count += __builtin_popcountll(bits_v);
+
+		const double* block = y + 64 * w;
+		for (int j = 0; j < 64; j += 4) {
+			// Expand 4 mask bits to 4 all-ones/all-zeros lanes
+			__m256i nibble_u = _mm256_set1_epi64x((bits_u >> j) & 0xF);
+			__m256i nibble_v = _mm256_set1_epi64x((bits_v >> j) & 0xF);
+			__m256d lanes_u = _mm256_castsi256_pd(_mm256_cmpeq_epi64(
+				_mm256_and_si256(nibble_u, lane_bits), lane_bits));
+			__m256d lanes_v = _mm256_castsi256_pd(_mm256_cmpeq_epi64(
+				_mm256_and_si256(nibble_v, lane_bits), lane_bits));
+
+			__m256d values = _mm256_loadu_pd(block + j);
+			__m256d yu = _mm256_and_pd(values, lanes_u);
+			__m256d yv = _mm256_and_pd(values, lanes_v);
+			sum_u = _mm256_add_pd(sum_u, yu);
+			sum_sq_u = _mm256_add_pd(sum_sq_u, _mm256_mul_pd(yu, yu));
+			sum_v = _mm256_add_pd(sum_v, yv);
+			sum_sq_v = _mm256_add_pd(sum_sq_v, _mm256_mul_pd(yv, yv));
+		}
+	}
+
+	u->sum += HorizontalSum(sum_u);
+	u->sum_sq += HorizontalSum(sum_sq_u);
+	v->sum += HorizontalSum(sum_v);
+	v->sum_sq += HorizontalSum(sum_sq_v);
+
+	// A partial last block can not be loaded whole
+	if (full_words * 64 < n) {
+		AddBits(mask_u[full_words], y + 64 * full_words, u);
+		AddBits(mask_v[full_words], y + 64 * full_words, v);
+	}
+}
+
+// ========================== //
+
+static inline double HorizontalSum(__m512d x) __attribute__((target("avx512f")));
+static inline double HorizontalSum(__m512d x) {
+	double lanes[8];
+	_mm512_storeu_pd(lanes, x);
+	return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3]))
+		+ ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+// ========================== //
+
+__attribute__((target("avx512f")))
+static void MaskedMomentsAVX512(const uint64_t* mask_u, const uint64_t* mask_v,
+	const double* y, size_t n, Moments* u, Moments* v) {
+
+	__m512d sum_u = _mm512_setzero_pd(), sum_sq_u = _mm512_setzero_pd();
+	__m512d sum_v = _mm512_setzero_pd(), sum_sq_v = _mm512_setzero_pd();
+
+	size_t full_words = n / 64;
+	for (size_t w = 0; w < full_words; ++w) {
+		uint64_t bits_u = mask_u[w];
+		uint64_t bits_v = mask_v[w];
+		if ((bits_u | bits_v) == 0) continue;
+		u->count += __builtin_popcountll(bits_u);
+		v->count += __builtin_popcountll(bits_v);
+
+		const double* block = y + 64 * w;
+		for (int j = 0; j < 64; j += 8) {
+			// The mask bits are the lane masks
+			__mmask8 lanes_u = static_cast<__mmask8>(bits_u >> j);
+			__mmask8 lanes_v = static_cast<__mmask8>(bits_v >> j);
+			__m512d values = _mm512_loadu_pd(block + j);
+			sum_u = _mm512_mask_add_pd(sum_u, lanes_u, sum_u, values);
+			sum_sq_u = _mm512_mask3_fmadd_pd(values, values, sum_sq_u, lanes_u);
+			sum_v = _mm512_mask_add_pd(sum_v, lanes_v, sum_v, values);
+			sum_sq_v = _mm512_mask3_fmadd_pd(values, values, sum_sq_v, lanes_v);
+		}
+	}
+
+	u->sum += HorizontalSum(sum_u);
+	u->sum_sq += HorizontalSum(sum_sq_u);
+	v->sum += HorizontalSum(sum_v);
+	v->sum_sq += HorizontalSum(sum_sq_v);
+
+	if (full_words * 64 < n) {
+		AddBits(mask_u[full_words], y + 64 * full_words, u);
+		AddBits(mask_v[full_words], y + 64 * full_words, v);
+	}
+}
+
+#endif // SPPM_X86_KERNELS
+
+// ==================================================== //
+
+vector<pair<string, MaskedMomentsKernel>> MaskedMomentsKernels() {
+	vector<pair<string, MaskedMomentsKernel>> kernels;
+	kernels.push_back(make_pair(string("scalar"), &MaskedMomentsScalar));
+#ifdef SPPM_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		kernels.push_back(make_pair(string("avx2"), &MaskedMomentsAVX2));
+	}
+	if (__builtin_cpu_supports("avx512f")) {
+		kernels.push_back(make_pair(string("avx512"), &MaskedMomentsAVX512));
+	}
+#endif
+	return kernels;
+}
+
+// ========================== //
+
+// The kernel named by SPPM_KERNEL if this CPU supports it, else the last
+// kernel of the list (the widest one)
+static pair<string, MaskedMomentsKernel> DefaultKernel() {
+	vector<pair<string, MaskedMomentsKernel>> kernels = MaskedMomentsKernels();
+	const char* forced = getenv("SPPM_KERNEL");
+	if (forced) {
+		for (const pair<string, MaskedMomentsKernel>& kernel : kernels) {
+			if (kernel.first == forced) return kernel;
+		}
+	}
+	return kernels.back();
+}
+
+static pair<string, MaskedMomentsKernel> s_kernel = DefaultKernel();
+
+// ========================== //
+
+void MaskedMoments(const uint64_t* mask_u, const uint64_t* mask_v,
+	const double* y, size_t n, Moments* u, Moments* v) {
+	s_kernel.second(mask_u, mask_v, y, n, u, v);
+}
+
+// ========================== //
+
+const char* MaskedMomentsKernelName() {
+	return s_kernel.first.c_str();
+}
+
+// ========================== //
+
+bool SetMaskedMomentsKernel(const string& name) {
+	for (const pair<string, MaskedMomentsKernel>& kernel : MaskedMomentsKernels()) {
+		if (kernel.first == name) {
+			s_kernel = kernel;
+			return true;
+		}
+	}
+	return false;
+}
+
+// ==================================================== //
+
+};
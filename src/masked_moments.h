@@ -0,0 +1,58 @@
+#ifndef SPPM_MASKED_MOMENTS_H_
+#define SPPM_MASKED_MOMENTS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Util {
+
+// ==================================================== //
+// Masked reductions over a contiguous attribute column: the count, sum and
+// sum of squares of the entries selected by each of two bitmasks (bit i of
+// mask[i / 64] selects y[i]), in a single pass. There are AVX-512, AVX2 and
+// scalar versions; the best one the CPU supports is picked at startup,
+// unless the SPPM_KERNEL environment variable names another one. The kernels
+// add in different orders, so the sums (and the samples of a seeded run)
+// match bit for bit only between machines running the same kernel.
+// ==================================================== //
+
+struct Moments {
+	double count;
+	double sum;
+	double sum_sq;
+
+	Moments() : count(0.0), sum(0.0), sum_sq(0.0) { }
+	void Merge(const Moments& other) {
+		count += other.count;
+		sum += other.sum;
+		sum_sq += other.sum_sq;
+	}
+};
+
+typedef void (*MaskedMomentsKernel)(const uint64_t* mask_u,
+	const uint64_t* mask_v, const double* y, size_t n, Moments* u, Moments* v);
+
+// ========================== //
+
+// Adds the moments of y[0..n) under mask_u to u and under mask_v to v
+void MaskedMoments(const uint64_t* mask_u, const uint64_t* mask_v,
+	const double* y, size_t n, Moments* u, Moments* v);
+
+// Name of the kernel picked for this CPU ("avx512", "avx2" or "scalar")
+const char* MaskedMomentsKernelName();
+
+// Uses the named kernel from now on (call it before sampling starts).
+// Returns false if it is not built in or not supported by this CPU.
+bool SetMaskedMomentsKernel(const std::string& name);
+
+// Every kernel built in and supported by this CPU, by name (benchmarks)
+std::vector<std::pair<std::string, MaskedMomentsKernel>> MaskedMomentsKernels();
+
+// ==================================================== //
+
+};
+
+#endif // SPPM_MASKED_MOMENTS_H_
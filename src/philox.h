@@ -0,0 +1,98 @@
+#ifndef SPPM_PHILOX_H_
+#define SPPM_PHILOX_H_
+
+#include <cstdint>
+
+namespace Util {
+
+// ==================================================== //
+
+// Philox4x32-10 counter-based generator (Salmon et al., "Parallel random
+// numbers: as easy as 1, 2, 3", SC'11). The output is a pure function of a
+// key and a 128-bit counter, so a stream is identified by its coordinates
+// instead of by some shared state:
+//
+//   key     = seed (64 bits)
+//   counter = (block, stream, iteration, chain)
+//
+// Any number of streams (e.g. one per component or per group, for a given
+// iteration) can be created on the spot, in any thread and in any order, and
+// always give the same numbers. Satisfies UniformRandomBitGenerator, so it
+// works with the std distributions and with Util's variates.
+class Philox {
+	public:
+		typedef uint32_t result_type;
+
+		static constexpr result_type min() { return 0; }
+		static constexpr result_type max() { return 0xffffffffu; }
+
+		explicit Philox(uint64_t seed = 0, uint32_t chain = 0,
+			uint32_t iteration = 0, uint32_t stream = 0) {
+			m_key[0] = static_cast<uint32_t>(seed);
+			m_key[1] = static_cast<uint32_t>(seed >> 32);
+			m_counter[0] = 0;
+			m_counter[1] = stream;
+			m_counter[2] = iteration;
+			m_counter[3] = chain;
+			m_index = 4;
+		}
+
+		result_type operator()() {
+			if (m_index == 4) {
+				Generate();
+				++m_counter[0];
+				m_index = 0;
+			}
+			return m_buffer[m_index++];
+		}
+
+		// Skip ahead n draws in constant time
+		void discard(unsigned long long n) {
+			// The buffer holds block (m_counter[0] - 1)
+			unsigned long long pos = 4ull * m_counter[0] + m_index - 4 + n;
+			m_counter[0] = static_cast<uint32_t>(pos / 4);
+			Generate();
+			++m_counter[0];
+			m_index = pos % 4;
+		}
+
+	private:
+		uint32_t m_key[2];
+		uint32_t m_counter[4];
+		uint32_t m_buffer[4];
+		int m_index;
+
+		static void MulHiLo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo) {
+			uint64_t product = static_cast<uint64_t>(a) * b;
+			hi = static_cast<uint32_t>(product >> 32);
+			lo = static_cast<uint32_t>(product);
+		}
+
+		// Ten rounds over the current counter, into m_buffer
+		void Generate() {
+			uint32_t k0 = m_key[0], k1 = m_key[1];
+			uint32_t c0 = m_counter[0], c1 = m_counter[1];
+			uint32_t c2 = m_counter[2], c3 = m_counter[3];
+			for (int round = 0; round < 10; ++round) {
+				uint32_t hi0, lo0, hi1, lo1;
+				MulHiLo(0xD2511F53u, c0, hi0, lo0);
+				MulHiLo(0xCD9E8D57u, c2, hi1, lo1);
+				c0 = hi1 ^ c1 ^ k0;
+				c1 = lo1;
+				c2 = hi0 ^ c3 ^ k1;
+				c3 = lo0;
+				k0 += 0x9E3779B9u;
+				k1 += 0xBB67AE85u;
+			}
+			m_buffer[0] = c0;
+			m_buffer[1] = c1;
+			m_buffer[2] = c2;
+			m_buffer[3] = c3;
+		}
+};
+
+// ==================================================== //
+
+};
+
+#endif // SPPM_PHILOX_H_
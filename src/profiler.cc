@@ -0,0 +1,310 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace Util {
+
+// ==================================================== //
+
+// Four histogram buckets per power of two of nanoseconds
+static const int kSubBuckets = 4;
+static const int kNumBuckets = 64 * kSubBuckets;
+
+static const char* const kPhaseNames[kNumPhases] = {
+	"load", "iteration", "sample_partition", "compute_log_ratio",
+	"find_group", "update_pi", "split_merge", "sample_rho", "sample_theta",
+	"sample_tree", "hold_partition", "hold_rho", "hold_theta", "hold_tree"
+};
+
+struct PhaseStats {
+	uint64_t calls;
+	int64_t total;
+	int64_t max;
+	uint64_t allocations;
+	uint64_t allocated_bytes;
+	uint64_t histogram[kNumBuckets];
+
+	PhaseStats() : calls(0), total(0), max(0), allocations(0), allocated_bytes(0) {
+		fill(histogram, histogram + kNumBuckets, 0);
+	}
+};
+
+// The stats of one phase on one thread. Only that thread writes them. The
+// counters are atomic so that TotalSeconds() and Allocations() can read them
+// while the thread runs; a relaxed load and store is enough with a single
+// writer and costs what plain ones do. The maximum and the histogram are
+// only read by WriteReport(), once the sampling threads are done.
+struct ThreadPhaseStats {
+	atomic<uint64_t> calls;
+	atomic<int64_t> total;
+	atomic<uint64_t> allocations;
+	atomic<uint64_t> allocated_bytes;
+	int64_t max;
+	uint64_t histogram[kNumBuckets];
+
+	ThreadPhaseStats() { Clear(); }
+
+	void Clear() {
+		calls.store(0, memory_order_relaxed);
+		total.store(0, memory_order_relaxed);
+		allocations.store(0, memory_order_relaxed);
+		allocated_bytes.store(0, memory_order_relaxed);
+		max = 0;
+		fill(histogram, histogram + kNumBuckets, 0);
+	}
+};
+
+struct ThreadProfile {
+	ThreadPhaseStats phases[kNumPhases];
+};
+
+// The profiles of every thread that recorded anything. They are owned here,
+// not by the threads, so they outlive the workers of short-lived pools.
+static mutex s_mutex;
+static vector<unique_ptr<ThreadProfile>> s_profiles;
+static chrono::steady_clock::time_point s_start;
+static thread_local ThreadProfile* t_profile = nullptr;
+
+// Innermost phase timed on this thread, and whether the thread is inside the
+// profiler (whose own allocations are not counted)
+static thread_local int t_phase = kNumPhases;
+static thread_local bool t_in_profiler = false;
+
+atomic<bool> Profiler::s_enabled(false);
+
+// ========================== //
+
+// Adds to a counter that only the calling thread writes
+template <class T>
+static inline void Add(atomic<T>& counter, T value) {
+	counter.store(counter.load(memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+template <class T>
+static inline T Read(const atomic<T>& counter) {
+	return counter.load(memory_order_relaxed);
+}
+
+// ========================== //
+
+static int Bucket(int64_t ns) {
+	if (ns < kSubBuckets) return max<int64_t>(ns, 0);
+	int exponent = 63 - __builtin_clzll(ns);
+	int sub = (ns >> (exponent - 2)) & (kSubBuckets - 1);
+	return exponent * kSubBuckets + sub;
+}
+
+// Middle of a bucket, in nanoseconds
+static double BucketValue(int bucket) {
+	if (bucket < kSubBuckets) return bucket;
+	int exponent = bucket / kSubBuckets;
+	int sub = bucket % kSubBuckets;
+	return (1.0 + (sub + 0.5) / kSubBuckets) * static_cast<double>(1ULL << exponent);
+}
+
+// ========================== //
+
+static ThreadProfile* LocalProfile() {
+	if (!t_profile) {
+		t_in_profiler = true;
+		lock_guard<mutex> lock(s_mutex);
+		s_profiles.emplace_back(new ThreadProfile());
+		t_profile = s_profiles.back().get();
+		t_in_profiler = false;
+	}
+	return t_profile;
+}
+
+// ========================== //
+
+void Profiler::Enable(bool enabled) {
+	lock_guard<mutex> lock(s_mutex);
+	s_start = chrono::steady_clock::now();
+	s_enabled.store(enabled);
+}
+
+// ========================== //
+
+void Profiler::Record(ProfilePhase phase, int64_t nanoseconds) {
+	ThreadPhaseStats& stats = LocalProfile()->phases[phase];
+	Add<uint64_t>(stats.calls, 1);
+	Add<int64_t>(stats.total, nanoseconds);
+	stats.max = max(stats.max, nanoseconds);
+	stats.histogram[Bucket(nanoseconds)]++;
+}
+
+// ========================== //
+
+int Profiler::EnterPhase(int phase) {
+	int previous = t_phase;
+	t_phase = phase;
+	return previous;
+}
+
+// ========================== //
+
+void Profiler::LeavePhase(int previous) {
+	t_phase = previous;
+}
+
+// ========================== //
+
+void Profiler::RecordAllocation(size_t bytes) {
+	if (t_phase == kNumPhases || t_in_profiler) return;
+	ThreadPhaseStats& stats = LocalProfile()->phases[t_phase];
+	Add<uint64_t>(stats.allocations, 1);
+	Add<uint64_t>(stats.allocated_bytes, bytes);
+}
+
+// ========================== //
+
+uint64_t Profiler::Allocations(ProfilePhase phase) {
+	lock_guard<mutex> lock(s_mutex);
+	uint64_t count = 0;
+	for (const unique_ptr<ThreadProfile>& profile : s_profiles) {
+		count += Read(profile->phases[phase].allocations);
+	}
+	return count;
+}
+
+// ========================== //
+
+const char* Profiler::PhaseName(ProfilePhase phase) {
+	return kPhaseNames[phase];
+}
+
+// ========================== //
+
+double Profiler::TotalSeconds(ProfilePhase phase, uint64_t* calls) {
+	lock_guard<mutex> lock(s_mutex);
+	int64_t total = 0;
+	uint64_t count = 0;
+	for (const unique_ptr<ThreadProfile>& profile : s_profiles) {
+		total += Read(profile->phases[phase].total);
+		count += Read(profile->phases[phase].calls);
+	}
+	if (calls) *calls = count;
+	return total * 1e-9;
+}
+
+// ========================== //
+
+void Profiler::Reset() {
+	lock_guard<mutex> lock(s_mutex);
+	for (const unique_ptr<ThreadProfile>& profile : s_profiles) {
+		for (int p = 0; p < kNumPhases; ++p) profile->phases[p].Clear();
+	}
+	s_start = chrono::steady_clock::now();
+}
+
+// ========================== //
+
+void Profiler::WriteReport(const string& filename) {
+	lock_guard<mutex> lock(s_mutex);
+	double wall = chrono::duration<double>(chrono::steady_clock::now() - s_start).count();
+
+	PhaseStats merged[kNumPhases];
+	for (const unique_ptr<ThreadProfile>& profile : s_profiles) {
+		for (int p = 0; p < kNumPhases; ++p) {
+			const ThreadPhaseStats& stats = profile->phases[p];
+			merged[p].calls += Read(stats.calls);
+			merged[p].total += Read(stats.total);
+			merged[p].max = max(merged[p].max, stats.max);
+			merged[p].allocations += Read(stats.allocations);
+			merged[p].allocated_bytes += Read(stats.allocated_bytes);
+			for (int b = 0; b < kNumBuckets; ++b) {
+				merged[p].histogram[b] += stats.histogram[b];
+			}
+		}
+	}
+
+	ofstream file(filename);
+	file << "{\n";
+	file << "  \"wall_seconds\": " << wall << ",\n";
+	file << "  \"threads\": " << s_profiles.size() << ",\n";
+	file << "  \"iterations\": " << merged[kPhaseIteration].calls << ",\n";
+	file << "  \"iterations_per_second\": "
+		<< (wall > 0 ? merged[kPhaseIteration].calls / wall : 0.0) << ",\n";
+#ifdef SPPM_COUNT_ALLOCATIONS
+	uint64_t allocations = 0;
+	for (int p = kPhaseIteration; p < kNumPhases; ++p) allocations += merged[p].allocations;
+	file << "  \"allocations_per_iteration\": " << (merged[kPhaseIteration].calls > 0
+		? static_cast<double>(allocations) / merged[kPhaseIteration].calls : 0.0) << ",\n";
+#endif
+	file << "  \"phases\": {";
+	bool first = true;
+	for (int p = 0; p < kNumPhases; ++p) {
+		const PhaseStats& stats = merged[p];
+		if (stats.calls == 0) continue;
+
+		// Percentiles of the call time, from the histogram
+		const double quantiles[] = {0.5, 0.9, 0.99};
+		double values[3];
+		for (int q = 0; q < 3; ++q) {
+			uint64_t rank = static_cast<uint64_t>(quantiles[q] * (stats.calls - 1));
+			uint64_t seen = 0;
+			int b = 0;
+			while (seen + stats.histogram[b] <= rank) seen += stats.histogram[b++];
+			values[q] = min(BucketValue(b), static_cast<double>(stats.max)) * 1e-3;
+		}
+
+		file << (first ? "\n" : ",\n");
+		first = false;
+		file << "    \"" << kPhaseNames[p] << "\": {\"calls\": " << stats.calls
+			<< ", \"total_seconds\": " << stats.total * 1e-9
+			<< ", \"mean_us\": " << stats.total * 1e-3 / stats.calls
+			<< ", \"p50_us\": " << values[0]
+			<< ", \"p90_us\": " << values[1]
+			<< ", \"p99_us\": " << values[2]
+			<< ", \"max_us\": " << stats.max * 1e-3;
+#ifdef SPPM_COUNT_ALLOCATIONS
+		file << ", \"allocations\": " << stats.allocations
+			<< ", \"allocated_bytes\": " << stats.allocated_bytes;
+#endif
+		file << "}";
+	}
+	file << "\n  }\n}\n";
+	if (!file) {
+		throw std::ios_base::failure("Failed to write the profile report.");
+	}
+}
+
+// ==================================================== //
+
+};
+
+// ==================================================== //
+// Counting allocator
+// ==================================================== //
+
+#ifdef SPPM_COUNT_ALLOCATIONS
+
+void* operator new(size_t size) {
+	Util::Profiler::RecordAllocation(size);
+	void* p = malloc(size == 0 ? 1 : size);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	free(p);
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef SPPM_PROFILER_H_
+#define SPPM_PROFILER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Util {
+
+// ==================================================== //
+// Scoped timers around the phases of the sampler. Each thread accumulates
+// its own call counts, totals and a log-scale histogram of the durations (no
+// sharing on the hot path); the report merges them. Phases nest, so the
+// totals are inclusive (SamplePartition contains ComputeLogRatio, which
+// contains FindGroup). While the profiler is disabled a timer costs a load
+// and a branch.
+//
+// Built with SPPM_COUNT_ALLOCATIONS, the global operator new also counts the
+// heap allocations (and bytes) of each thread, charged to the innermost phase
+// being timed, and the report includes them.
+// ==================================================== //
+
+enum ProfilePhase {
+	kPhaseLoad,
+	kPhaseIteration,
+	kPhaseSamplePartition,
+	kPhaseComputeLogRatio,
+	kPhaseFindGroup,
+	kPhaseUpdatePi,
+	kPhaseSplitMerge,
+	kPhaseSampleRho,
+	kPhaseSampleTheta,
+	kPhaseSampleTree,
+	kPhaseHoldPartition,
+	kPhaseHoldRho,
+	kPhaseHoldTheta,
+	kPhaseHoldTree,
+	kNumPhases
+};
+
+class Profiler {
+	public:
+		static void Enable(bool enabled = true);
+		static bool Enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+		// Adds one call of a phase, on the calling thread
+		static void Record(ProfilePhase phase, int64_t nanoseconds);
+
+		// Writes the merged results as JSON: per phase the number of calls,
+		// total time and percentiles of the call time, plus the wall time
+		// since Enable() and the sampler iterations per second
+		static void WriteReport(const std::string& filename);
+
+		// Total time (in seconds) and number of calls of a phase so far, over
+		// every thread, and a fresh start for the next measurement. Meant for
+		// benchmarks and periodic reports: the totals can be read while other
+		// threads record, though a call being recorded may be missed until
+		// the next read. Reset() must not run while any thread records.
+		static double TotalSeconds(ProfilePhase phase, uint64_t* calls = nullptr);
+		static void Reset();
+
+		// Name of a phase in the reports ("sample_partition")
+		static const char* PhaseName(ProfilePhase phase);
+
+		// Allocation counting (SPPM_COUNT_ALLOCATIONS). EnterPhase() makes a
+		// phase the innermost one of the calling thread and returns the
+		// previous one, for LeavePhase().
+		static int EnterPhase(int phase);
+		static void LeavePhase(int previous);
+		static void RecordAllocation(size_t bytes);
+		static uint64_t Allocations(ProfilePhase phase);
+
+	private:
+		static std::atomic<bool> s_enabled;
+};
+
+// ========================== //
+
+class ScopedTimer {
+	public:
+		explicit ScopedTimer(ProfilePhase phase)
+			: m_phase(phase), m_active(Profiler::Enabled()), m_parent(kNumPhases) {
+			if (!m_active) return;
+#ifdef SPPM_COUNT_ALLOCATIONS
+			m_parent = Profiler::EnterPhase(phase);
+#endif
+			m_start = std::chrono::steady_clock::now();
+		}
+
+		~ScopedTimer() {
+			if (!m_active) return;
+			std::chrono::steady_clock::duration elapsed =
+				std::chrono::steady_clock::now() - m_start;
+			Profiler::Record(m_phase,
+				std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+#ifdef SPPM_COUNT_ALLOCATIONS
+			Profiler::LeavePhase(m_parent);
+#endif
+		}
+
+	private:
+		ProfilePhase m_phase;
+		bool m_active;
+		int m_parent;
+		std::chrono::steady_clock::time_point m_start;
+};
+
+// ==================================================== //
+
+};
+
+#endif // SPPM_PROFILER_H_
@@ -0,0 +1,222 @@
+#include "progress.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "log.h"
+#include "profiler.h"
+
+using namespace std;
+
+namespace Util {
+
+// ==================================================== //
+
+ProgressReporter::ProgressReporter()
+	: m_interval(0), m_console(true), m_chain(0), m_prometheus_failed(false),
+	  m_num_iter(0),
+	  m_max_seconds(0), m_last_iteration(0) {
+	m_metrics_file.exceptions(ofstream::failbit | ofstream::badbit);
+}
+
+// ========================== //
+
+void ProgressReporter::SetInterval(double seconds) {
+	m_interval = max(seconds, 0.0);
+}
+
+// ========================== //
+
+void ProgressReporter::SetConsole(bool console) {
+	m_console = console;
+}
+
+// ========================== //
+
+void ProgressReporter::SetMetricsFile(const string& filename) {
+	m_metrics_filename = filename;
+}
+
+// ========================== //
+
+void ProgressReporter::SetPrometheusFile(const string& filename, uint32_t chain) {
+	m_prometheus_filename = filename;
+	m_chain = chain;
+}
+
+// ========================== //
+
+void ProgressReporter::Start(int num_iter, double max_seconds) {
+	m_num_iter = num_iter;
+	m_max_seconds = max_seconds;
+	m_start = m_last = Clock::now();
+	m_next = m_start + chrono::duration_cast<Clock::duration>(
+		chrono::duration<double>(m_interval));
+	m_last_iteration = 0;
+	if (m_interval > 0 && !m_metrics_filename.empty()) {
+		if (m_metrics_file.is_open()) m_metrics_file.close();
+		m_metrics_file.open(m_metrics_filename);
+	}
+}
+
+// ========================== //
+
+void ProgressReporter::Report(const ProgressState& state) {
+	Write(state, false);
+}
+
+// ========================== //
+
+void ProgressReporter::Finish(const ProgressState& state) {
+	if (m_interval <= 0) return;
+	Write(state, true);
+	if (m_metrics_file.is_open()) m_metrics_file.close();
+}
+
+// ========================== //
+
+// Seconds as h:mm:ss
+static string FormatDuration(double seconds) {
+	long total = static_cast<long>(seconds + 0.5);
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%ld:%02ld:%02ld", total / 3600,
+		(total / 60) % 60, total % 60);
+	return buffer;
+}
+
+// ========================== //
+
+// Resident memory of the process, in bytes (0 if unknown)
+static uint64_t ResidentBytes() {
+	ifstream statm("/proc/self/statm");
+	long size = 0, resident = 0;
+	statm >> size >> resident;
+	return static_cast<uint64_t>(resident) * sysconf(_SC_PAGESIZE);
+}
+
+// ========================== //
+
+void ProgressReporter::Write(const ProgressState& state, bool done) {
+	Clock::time_point now = Clock::now();
+	double elapsed = chrono::duration<double>(now - m_start).count();
+	double since_last = chrono::duration<double>(now - m_last).count();
+	double rate = since_last > 0
+		? (state.iteration - m_last_iteration) / since_last : 0.0;
+
+	// Time left at the mean rate of the run, capped by the time limit
+	double eta = -1;
+	if (!done && state.iteration > 0 && m_num_iter > 0) {
+		eta = (m_num_iter - state.iteration) * elapsed / state.iteration;
+	}
+	if (!done && m_max_seconds > 0) {
+		double left = max(m_max_seconds - elapsed, 0.0);
+		eta = eta < 0 ? left : min(eta, left);
+	}
+
+	if (m_console) {
+		cout << " -- Iteration " << state.iteration;
+		if (m_num_iter > 0) {
+			cout << " of " << m_num_iter << " ("
+				<< 100 * static_cast<long>(state.iteration) / m_num_iter << "%)";
+		}
+		cout << ": " << rate << " it/s, " << state.num_groups << " groups, rho "
+			<< state.rho;
+		if (eta >= 0) cout << ", ETA " << FormatDuration(eta);
+		if (done) cout << ", done in " << FormatDuration(elapsed);
+		cout << endl;
+	}
+
+	if (m_metrics_file.is_open()) {
+		m_metrics_file << "{\"seconds\": " << elapsed
+			<< ", \"iteration\": " << state.iteration
+			<< ", \"num_iter\": " << m_num_iter
+			<< ", \"iterations_per_second\": " << rate
+			<< ", \"num_groups\": " << state.num_groups
+			<< ", \"rho\": " << state.rho
+			<< ", \"eta_seconds\": " << (eta >= 0 ? eta : 0.0)
+			<< ", \"done\": " << (done ? "true" : "false") << "}" << endl;
+	}
+
+	if (!m_prometheus_filename.empty()) {
+		try {
+			WritePrometheus(state, rate, done);
+		} catch (const std::ios_base::failure& e) {
+			if (!m_prometheus_failed) {
+				SPPM_LOG(WARNING) << "Failed to write the Prometheus file '"
+					<< m_prometheus_filename << "' (" << e.what()
+					<< "); the reports that fail to write it are skipped";
+				m_prometheus_failed = true;
+			}
+		}
+	}
+
+	m_last = now;
+	m_last_iteration = state.iteration;
+	m_next = now + chrono::duration_cast<Clock::duration>(
+		chrono::duration<double>(m_interval));
+}
+
+// ========================== //
+
+void ProgressReporter::WritePrometheus(const ProgressState& state, double rate,
+	bool done) const {
+
+	string label = "chain=\"" + to_string(m_chain) + "\"";
+	string temp_filename = m_prometheus_filename + ".tmp";
+	ofstream file;
+	file.exceptions(ofstream::failbit | ofstream::badbit);
+	file.open(temp_filename);
+
+	file << "# HELP sppm_iterations_total Sampler iterations run.\n"
+		<< "# TYPE sppm_iterations_total counter\n"
+		<< "sppm_iterations_total{" << label << "} " << state.iteration << "\n"
+		<< "# HELP sppm_iterations_target Iterations the run was started for.\n"
+		<< "# TYPE sppm_iterations_target gauge\n"
+		<< "sppm_iterations_target{" << label << "} " << m_num_iter << "\n"
+		<< "# HELP sppm_iterations_per_second Iterations per second since the "
+			"previous report.\n"
+		<< "# TYPE sppm_iterations_per_second gauge\n"
+		<< "sppm_iterations_per_second{" << label << "} " << rate << "\n"
+		<< "# HELP sppm_groups Number of groups of the current partition.\n"
+		<< "# TYPE sppm_groups gauge\n"
+		<< "sppm_groups{" << label << "} " << state.num_groups << "\n"
+		<< "# HELP sppm_rho Current value of rho.\n"
+		<< "# TYPE sppm_rho gauge\n"
+		<< "sppm_rho{" << label << "} " << state.rho << "\n"
+		<< "# HELP sppm_output_bytes_total Bytes written to the sample files.\n"
+		<< "# TYPE sppm_output_bytes_total counter\n"
+		<< "sppm_output_bytes_total{" << label << "} " << state.output_bytes << "\n"
+		<< "# HELP sppm_resident_memory_bytes Resident memory of the process.\n"
+		<< "# TYPE sppm_resident_memory_bytes gauge\n"
+		<< "sppm_resident_memory_bytes{" << label << "} " << ResidentBytes() << "\n"
+		<< "# HELP sppm_done Whether the run has finished.\n"
+		<< "# TYPE sppm_done gauge\n"
+		<< "sppm_done{" << label << "} " << (done ? 1 : 0) << "\n";
+
+	// Only the phases timed so far (none if the profiler is off). The times
+	// are of the whole process, so they have no chain label.
+	file << "# HELP sppm_phase_seconds_total Time spent in each sampler phase, "
+			"by every chain of the process.\n"
+		<< "# TYPE sppm_phase_seconds_total counter\n";
+	for (int p = 0; p < kNumPhases; ++p) {
+		ProfilePhase phase = static_cast<ProfilePhase>(p);
+		uint64_t calls = 0;
+		double seconds = Profiler::TotalSeconds(phase, &calls);
+		if (calls == 0) continue;
+		file << "sppm_phase_seconds_total{phase=\""
+			<< Profiler::PhaseName(phase) << "\"} " << seconds << "\n";
+	}
+	file.close();
+
+	if (rename(temp_filename.c_str(), m_prometheus_filename.c_str()) != 0) {
+		throw std::ios_base::failure("Failed to rename " + temp_filename
+			+ " to " + m_prometheus_filename);
+	}
+}
+
+// ==================================================== //
+
+};
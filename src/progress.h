@@ -0,0 +1,92 @@
+#ifndef SPPM_PROGRESS_H_
+#define SPPM_PROGRESS_H_
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace Util {
+
+// ==================================================== //
+// Progress of a run, sampled on a timer. At most once per interval a line
+// with the iterations per second (since the previous report), the number of
+// groups, rho and the estimated time left is printed, and the same values are
+// appended to the metrics file as a JSON object per line. Between reports a
+// check costs a clock read.
+//
+// The reports can also rewrite a file in the Prometheus text format (for the
+// textfile collector of node_exporter): the counts above, the bytes of output
+// written and the resident memory, labelled with the chain id, and the time
+// spent in each profiled phase (see profiler.h). The profiler times the whole
+// process, so the phase times are not labelled with a chain: with parallel
+// tempering they add up the time of every replica. The file is written aside
+// and renamed over the old one, so it is never read half written. A failed
+// write only skips that report (with a warning the first time): the run
+// goes on.
+// ==================================================== //
+
+// The state of the sampler at a report
+struct ProgressState {
+	int iteration;
+	int num_groups;
+	double rho;
+	uint64_t output_bytes;
+};
+
+// ========================== //
+
+class ProgressReporter {
+	public:
+		ProgressReporter();
+
+		// Seconds between reports (0 turns them off), whether they are
+		// printed to the standard output, the metrics file and the
+		// Prometheus file (none if empty) and the chain id of its labels
+		void SetInterval(double seconds);
+		void SetConsole(bool console);
+		void SetMetricsFile(const std::string& filename);
+		void SetPrometheusFile(const std::string& filename, uint32_t chain);
+
+		// Starts a run of num_iter iterations (0 if not known) that may also
+		// be stopped after max_seconds (0 if not)
+		void Start(int num_iter, double max_seconds);
+
+		// Whether a report is due. Called after every iteration.
+		bool Due() const {
+			return m_interval > 0 && Clock::now() >= m_next;
+		}
+		void Report(const ProgressState& state);
+
+		// The last report (always made, unless reports are off); closes the
+		// metrics file
+		void Finish(const ProgressState& state);
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		double m_interval;
+		bool m_console;
+		std::string m_metrics_filename;
+		std::ofstream m_metrics_file;
+		std::string m_prometheus_filename;
+		uint32_t m_chain;
+		bool m_prometheus_failed;
+
+		int m_num_iter;
+		double m_max_seconds;
+		Clock::time_point m_start;
+		Clock::time_point m_last;
+		Clock::time_point m_next;
+		int m_last_iteration;
+
+		void Write(const ProgressState& state, bool done);
+		void WritePrometheus(const ProgressState& state, double rate,
+			bool done) const;
+};
+
+// ==================================================== //
+
+};
+
+#endif // SPPM_PROGRESS_H_
@@ -0,0 +1,383 @@
+#include "sample_sink.h"
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "log.h"
+#include "profiler.h"
+
+using namespace std;
+
+namespace Util {
+
+// ==================================================== //
+
+// Path of a file in a directory ("" for the current one)
+static string JoinPath(const string& directory, const string& filename) {
+	if (directory.empty()) return filename;
+	return directory + "/" + filename;
+}
+
+// ========================== //
+
+// Opens an output file, which then throws on any failure
+static void OpenOutput(ofstream& file, const string& path,
+	ios_base::openmode mode = ofstream::out) {
+	SPPM_LOG(INFO) << " -- Preparing output file '" << path << "'";
+	file.exceptions(ofstream::failbit | ofstream::badbit);
+	if (file.is_open()) file.close();
+	file.open(path, mode);
+}
+
+// ========================== //
+
+// The ids of the nodes as a CSV line
+static void WriteIdLine(ofstream& file, const vector<long long>& node_ids) {
+	bool first = true;
+	for (long long id : node_ids) {
+		if (first) {
+			file << id;
+			first = false;
+		}
+		else {
+			file << "," << id;
+		}
+	}
+	file << endl;
+}
+
+// ========================== //
+
+static uint64_t FilePosition(ofstream& file) {
+	return file.is_open() ? static_cast<uint64_t>(file.tellp()) : 0;
+}
+
+// ==================================================== //
+
+CsvSink::CsvSink(const string& directory) : m_directory(directory) {
+}
+
+// ========================== //
+
+void CsvSink::Open(const SampleHeader& header) {
+	OpenOutput(m_pi_file, JoinPath(m_directory, "pi.csv"));
+	WriteIdLine(m_pi_file, header.node_ids);
+
+	OpenOutput(m_tree_file, JoinPath(m_directory, "tree.csv"));
+	m_tree_file << "U_1,V_1";
+	for (int curr = 2; curr <= header.num_tree_edges; ++curr) {
+		m_tree_file << ",U_" << curr << ",V_" << curr;
+	}
+	m_tree_file << endl;
+
+	OpenOutput(m_rho_file, JoinPath(m_directory, "rho.csv"));
+	m_rho_file << "rho" << endl;
+
+	m_param_names = header.param_names;
+	m_theta_files.clear();
+	for (const string& name : m_param_names) {
+		m_theta_files.emplace_back(new ofstream());
+		OpenOutput(*m_theta_files.back(), JoinPath(m_directory, name + ".csv"));
+		WriteIdLine(*m_theta_files.back(), header.node_ids);
+	}
+}
+
+// ========================== //
+
+void CsvSink::Write(const SampleView& sample) {
+	{
+		ScopedTimer timer(kPhaseHoldPartition);
+		try {
+			bool first = true;
+			for (long long label : sample.labels) {
+				if (first) {
+					m_pi_file << label;
+					first = false;
+				}
+				else {
+					m_pi_file << "," << label;
+				}
+			}
+			m_pi_file << endl;
+		} catch (...) {
+			throw std::ios_base::failure("Failed to write partition to file.");
+		}
+	}
+
+	{
+		ScopedTimer timer(kPhaseHoldRho);
+		try {
+			m_rho_file << sample.rho << endl;
+		} catch (...) {
+			throw std::ios_base::failure("Failed to write rho to file.");
+		}
+	}
+
+	{
+		ScopedTimer timer(kPhaseHoldTheta);
+		for (size_t k = 0; k < m_theta_files.size(); ++k) {
+			try {
+				ofstream& file = *m_theta_files[k];
+				const vector<double>& theta = sample.theta[k];
+				bool first = true;
+				for (long long label : sample.labels) {
+					if (!first) file << ",";
+					else first = false;
+					file << theta[label];
+				}
+				file << endl;
+			} catch (...) {
+				throw std::ios_base::failure("Failed to write theta to file.");
+			}
+		}
+	}
+
+	{
+		ScopedTimer timer(kPhaseHoldTree);
+		try {
+			bool first = true;
+			for (const pair<long long, long long>& edge : sample.tree) {
+				if (!first) m_tree_file << ",";
+				else first = false;
+				m_tree_file << edge.first << "," << edge.second;
+			}
+			m_tree_file << endl;
+		} catch (...) {
+			throw std::ios_base::failure("Failed to write tree to file.");
+		}
+	}
+}
+
+// ========================== //
+
+void CsvSink::Close() {
+	SPPM_LOG(INFO) << "== Closing output file 'pi.csv'";
+	if (m_pi_file.is_open()) m_pi_file.close();
+	SPPM_LOG(INFO) << "== Closing output file 'rho.csv'";
+	if (m_rho_file.is_open()) m_rho_file.close();
+	for (size_t k = 0; k < m_theta_files.size(); ++k) {
+		SPPM_LOG(INFO) << " -- Closing output file '" << m_param_names[k] << ".csv'";
+		if (m_theta_files[k]->is_open()) m_theta_files[k]->close();
+	}
+	SPPM_LOG(INFO) << "== Closing output file 'tree.csv'";
+	if (m_tree_file.is_open()) m_tree_file.close();
+}
+
+// ========================== //
+
+uint64_t CsvSink::BytesWritten() {
+	uint64_t bytes = FilePosition(m_pi_file) + FilePosition(m_tree_file)
+		+ FilePosition(m_rho_file);
+	for (const unique_ptr<ofstream>& file : m_theta_files) bytes += FilePosition(*file);
+	return bytes;
+}
+
+// ==================================================== //
+
+template <class T>
+static void WriteValue(ofstream& file, T value) {
+	file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// ========================== //
+
+BinarySink::BinarySink(const string& directory) : m_directory(directory) {
+}
+
+// ========================== //
+
+void BinarySink::Open(const SampleHeader& header) {
+	OpenOutput(m_file, JoinPath(m_directory, "samples.bin"),
+		ofstream::out | ofstream::binary);
+	m_file.write("SPPMSMP1", 8);
+	WriteValue<int32_t>(m_file, header.node_ids.size());
+	WriteValue<int32_t>(m_file, header.num_tree_edges);
+	WriteValue<int32_t>(m_file, header.param_names.size());
+	for (long long id : header.node_ids) WriteValue<int64_t>(m_file, id);
+	for (const string& name : header.param_names) {
+		WriteValue<int32_t>(m_file, name.size());
+		m_file.write(name.data(), name.size());
+	}
+}
+
+// ========================== //
+
+void BinarySink::Write(const SampleView& sample) {
+	m_labels.assign(sample.labels.begin(), sample.labels.end());
+	m_tree.resize(2 * sample.tree.size());
+	for (size_t i = 0; i < sample.tree.size(); ++i) {
+		m_tree[2 * i] = sample.tree[i].first;
+		m_tree[2 * i + 1] = sample.tree[i].second;
+	}
+
+	try {
+		WriteValue<int32_t>(m_file, sample.iteration);
+		WriteValue<int32_t>(m_file, sample.num_groups);
+		WriteValue<double>(m_file, sample.rho);
+		m_file.write(reinterpret_cast<const char*>(m_labels.data()),
+			m_labels.size() * sizeof(int32_t));
+		WriteValue<int32_t>(m_file, sample.tree.size());
+		m_file.write(reinterpret_cast<const char*>(m_tree.data()),
+			m_tree.size() * sizeof(int64_t));
+		for (const vector<double>& theta : sample.theta) {
+			m_file.write(reinterpret_cast<const char*>(theta.data() + 1),
+				sample.num_groups * sizeof(double));
+		}
+	} catch (...) {
+		throw std::ios_base::failure("Failed to write samples.bin.");
+	}
+}
+
+// ========================== //
+
+void BinarySink::Close() {
+	SPPM_LOG(INFO) << "== Closing output file 'samples.bin'";
+	if (m_file.is_open()) m_file.close();
+}
+
+// ========================== //
+
+uint64_t BinarySink::BytesWritten() {
+	return FilePosition(m_file);
+}
+
+// ==================================================== //
+
+SummarySink::SummarySink(const string& directory)
+	: m_directory(directory), m_count(0), m_sum_groups(0), m_sum_sq_groups(0),
+	  m_sum_rho(0), m_sum_sq_rho(0) {
+}
+
+// ========================== //
+
+void SummarySink::Open(const SampleHeader& header) {
+	m_header = header;
+	m_count = 0;
+	m_sum_groups = m_sum_sq_groups = m_sum_rho = m_sum_sq_rho = 0;
+	m_sum_theta.assign(header.param_names.size(),
+		vector<double>(header.node_ids.size(), 0.0));
+}
+
+// ========================== //
+
+void SummarySink::Write(const SampleView& sample) {
+	m_count++;
+	m_sum_groups += sample.num_groups;
+	m_sum_sq_groups += double(sample.num_groups) * sample.num_groups;
+	m_sum_rho += sample.rho;
+	m_sum_sq_rho += sample.rho * sample.rho;
+	for (size_t k = 0; k < m_sum_theta.size(); ++k) {
+		vector<double>& sum = m_sum_theta[k];
+		const vector<double>& theta = sample.theta[k];
+		for (size_t i = 0; i < sum.size(); ++i) sum[i] += theta[sample.labels[i]];
+	}
+}
+
+// ========================== //
+
+void SummarySink::Close() {
+	double n = max<long long>(m_count, 1);
+	double mean_groups = m_sum_groups / n;
+	double mean_rho = m_sum_rho / n;
+	double sd_groups = sqrt(max(m_sum_sq_groups / n - mean_groups * mean_groups, 0.0));
+	double sd_rho = sqrt(max(m_sum_sq_rho / n - mean_rho * mean_rho, 0.0));
+
+	ofstream stats;
+	OpenOutput(stats, JoinPath(m_directory, "summary_stats.csv"));
+	stats << "samples,mean_groups,sd_groups,mean_rho,sd_rho" << endl;
+	stats << m_count << "," << mean_groups << "," << sd_groups << ","
+		<< mean_rho << "," << sd_rho << endl;
+
+	ofstream file;
+	OpenOutput(file, JoinPath(m_directory, "summary.csv"));
+	file << "node";
+	for (const string& name : m_header.param_names) file << "," << name << "_mean";
+	file << endl;
+	for (size_t i = 0; i < m_header.node_ids.size(); ++i) {
+		file << m_header.node_ids[i];
+		for (const vector<double>& sum : m_sum_theta) file << "," << sum[i] / n;
+		file << "\n";
+	}
+	file.close();
+	SPPM_LOG(INFO) << "== Summary of " << m_count << " samples: " << mean_groups
+		<< " groups (sd " << sd_groups << "), rho " << mean_rho << " (sd "
+		<< sd_rho << ")";
+}
+
+// ==================================================== //
+
+void MultiSink::Add(unique_ptr<SampleSink> sink) {
+	m_sinks.push_back(move(sink));
+}
+
+// ========================== //
+
+void MultiSink::Open(const SampleHeader& header) {
+	for (const unique_ptr<SampleSink>& sink : m_sinks) sink->Open(header);
+}
+
+// ========================== //
+
+void MultiSink::Write(const SampleView& sample) {
+	for (const unique_ptr<SampleSink>& sink : m_sinks) sink->Write(sample);
+}
+
+// ========================== //
+
+void MultiSink::Close() {
+	for (const unique_ptr<SampleSink>& sink : m_sinks) sink->Close();
+}
+
+// ========================== //
+
+uint64_t MultiSink::BytesWritten() {
+	uint64_t bytes = 0;
+	for (const unique_ptr<SampleSink>& sink : m_sinks) bytes += sink->BytesWritten();
+	return bytes;
+}
+
+// ==================================================== //
+
+// Splits the list, rejecting unknown and empty names
+static vector<string> SinkNames(const string& names) {
+	vector<string> result;
+	stringstream stream(names);
+	string name;
+	while (getline(stream, name, ',')) {
+		if (name != "csv" && name != "binary" && name != "summary" && name != "null") {
+			throw std::invalid_argument("Unknown sample sink: '" + name + "'");
+		}
+		result.push_back(name);
+	}
+	if (result.empty()) throw std::invalid_argument("No sample sink given");
+	return result;
+}
+
+// ========================== //
+
+bool ValidSinkNames(const string& names) {
+	try {
+		SinkNames(names);
+	} catch (const std::invalid_argument&) {
+		return false;
+	}
+	return true;
+}
+
+// ========================== //
+
+unique_ptr<SampleSink> CreateSinks(const string& names, const string& directory) {
+	unique_ptr<MultiSink> sinks(new MultiSink());
+	for (const string& name : SinkNames(names)) {
+		if (name == "csv") sinks->Add(unique_ptr<SampleSink>(new CsvSink(directory)));
+		else if (name == "binary") sinks->Add(unique_ptr<SampleSink>(new BinarySink(directory)));
+		else if (name == "summary") sinks->Add(unique_ptr<SampleSink>(new SummarySink(directory)));
+		else sinks->Add(unique_ptr<SampleSink>(new NullSink()));
+	}
+	return move(sinks);
+}
+
+// ==================================================== //
+
+};
@@ -0,0 +1,170 @@
+#ifndef SPPM_SAMPLE_SINK_H_
+#define SPPM_SAMPLE_SINK_H_
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Util {
+
+// ==================================================== //
+// Sinks of the held samples. The sampler hands each sink a read-only view
+// of its state; the sink decides what to keep and where. A run writes to any
+// combination of:
+//   csv      pi.csv, tree.csv, rho.csv and a file per parameter (mu.csv...)
+//   binary   samples.bin, every sample in a compact binary form
+//   summary  summary.csv, the posterior mean of each parameter per node, and
+//            summary_stats.csv with the means and deviations of the number
+//            of groups and of rho
+//   null     nothing (for benchmarks)
+// ==================================================== //
+
+// What does not change between samples: the external ids of the nodes (the
+// order of the labels in every sample), the number of edges of a spanning
+// forest and the names of the group parameters
+struct SampleHeader {
+	std::vector<long long> node_ids;
+	int num_tree_edges;
+	std::vector<std::string> param_names;
+};
+
+// A held sample. The labels follow the order of SampleHeader::node_ids, the
+// tree edges are pairs of node ids and theta[k][g] is the k-th parameter of
+// group g (1..num_groups).
+struct SampleView {
+	int iteration;
+	int num_groups;
+	double rho;
+	const std::vector<long long>& labels;
+	const std::vector<std::pair<long long, long long>>& tree;
+	const std::vector<std::vector<double>>& theta;
+};
+
+// ========================== //
+
+class SampleSink {
+	public:
+		virtual ~SampleSink() {}
+
+		virtual void Open(const SampleHeader& header) = 0;
+		virtual void Write(const SampleView& sample) = 0;
+		virtual void Close() = 0;
+
+		// Bytes written so far (buffered ones included)
+		virtual uint64_t BytesWritten() { return 0; }
+};
+
+// ========================== //
+
+// The files of the original output format, in directory ("" for the
+// current one). The hold_* profiler phases time their writes.
+class CsvSink: public SampleSink {
+	public:
+		explicit CsvSink(const std::string& directory);
+
+		void Open(const SampleHeader& header);
+		void Write(const SampleView& sample);
+		void Close();
+		uint64_t BytesWritten();
+
+	private:
+		std::string m_directory;
+		std::ofstream m_pi_file;
+		std::ofstream m_tree_file;
+		std::ofstream m_rho_file;
+		std::vector<std::unique_ptr<std::ofstream>> m_theta_files;
+		std::vector<std::string> m_param_names;
+};
+
+// ========================== //
+
+// samples.bin: the magic "SPPMSMP1", then the 32-bit number of nodes, of
+// tree edges and of parameters, the 64-bit node ids and the parameter names
+// (each a 32-bit length and the characters). Each sample follows as the
+// 32-bit iteration and number of groups c, the double rho, the 32-bit labels,
+// the 32-bit number of tree edges and the 64-bit ids of their ends, and for
+// each parameter the c doubles of groups 1..c, all in the byte order of the
+// host.
+class BinarySink: public SampleSink {
+	public:
+		explicit BinarySink(const std::string& directory);
+
+		void Open(const SampleHeader& header);
+		void Write(const SampleView& sample);
+		void Close();
+		uint64_t BytesWritten();
+
+	private:
+		std::string m_directory;
+		std::ofstream m_file;
+		std::vector<int32_t> m_labels;
+		std::vector<int64_t> m_tree;
+};
+
+// ========================== //
+
+// Running means over the samples, written when the sink is closed
+class SummarySink: public SampleSink {
+	public:
+		explicit SummarySink(const std::string& directory);
+
+		void Open(const SampleHeader& header);
+		void Write(const SampleView& sample);
+		void Close();
+
+	private:
+		std::string m_directory;
+		SampleHeader m_header;
+		long long m_count;
+		double m_sum_groups;
+		double m_sum_sq_groups;
+		double m_sum_rho;
+		double m_sum_sq_rho;
+
+		// Sum of the k-th parameter of each node's group, by node
+		std::vector<std::vector<double>> m_sum_theta;
+};
+
+// ========================== //
+
+class NullSink: public SampleSink {
+	public:
+		void Open(const SampleHeader&) {}
+		void Write(const SampleView&) {}
+		void Close() {}
+};
+
+// ========================== //
+
+// Forwards every call to each of its sinks, in order
+class MultiSink: public SampleSink {
+	public:
+		void Add(std::unique_ptr<SampleSink> sink);
+
+		void Open(const SampleHeader& header);
+		void Write(const SampleView& sample);
+		void Close();
+		uint64_t BytesWritten();
+
+	private:
+		std::vector<std::unique_ptr<SampleSink>> m_sinks;
+};
+
+// ========================== //
+
+// Whether names is a valid comma separated list of sinks ("csv,summary")
+bool ValidSinkNames(const std::string& names);
+
+// The sinks of a comma separated list, writing to directory. Throws
+// std::invalid_argument for an unknown name.
+std::unique_ptr<SampleSink> CreateSinks(const std::string& names,
+	const std::string& directory);
+
+// ==================================================== //
+
+};
+
+#endif // SPPM_SAMPLE_SINK_H_
@@ -0,0 +1,306 @@
+#include "sppm/sampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include <lemon/smart_graph.h>
+
+#include "log.h"
+#include "sppm_normal.h"
+#include "sppm_poisson.h"
+#include "util.h"
+
+using namespace std;
+
+// ==================================================== //
+
+// The sink of the sampler: passes each held sample on to the callback,
+// with the labels reordered by node index (node i of the view is the node
+// with id i, so the tree edges already are pairs of indices)
+class CallbackSink: public Util::SampleSink {
+	public:
+		explicit CallbackSink(const SPPM_Sampler::Callback& callback)
+			: m_callback(callback) {
+		}
+
+		void Open(const Util::SampleHeader& header) {
+			m_node_ids = header.node_ids;
+			m_labels.assign(m_node_ids.size(), 0);
+		}
+
+		void Write(const Util::SampleView& sample) {
+			if (!m_callback) return;
+			for (size_t k = 0; k < m_node_ids.size(); ++k) {
+				m_labels[m_node_ids[k]] = sample.labels[k];
+			}
+			SPPM_Sample held = {sample.iteration, sample.num_groups, sample.rho,
+				m_labels, sample.tree, sample.theta};
+			m_callback(held);
+		}
+
+		void Close() {}
+
+	private:
+		const SPPM_Sampler::Callback& m_callback;
+		vector<long long> m_node_ids;
+		vector<long long> m_labels;
+};
+
+// ========================== //
+
+// The log callbacks of the samplers, by the id of their logger
+static mutex s_log_mutex;
+static map<string, const SPPM_Options::Log*> s_logs;
+static int s_num_loggers = 0;
+
+// Passes the lines of each sampler's logger on to its log callback. The
+// callback is copied and called without holding s_log_mutex, so it may log
+// itself.
+class LogForwarder: public el::LogDispatchCallback {
+	protected:
+		void handle(const el::LogDispatchData* data) {
+			const el::LogMessage* message = data->logMessage();
+			SPPM_Options::Log log;
+			{
+				lock_guard<mutex> lock(s_log_mutex);
+				auto it = s_logs.find(message->logger()->id());
+				if (it == s_logs.end()) return;
+				log = *it->second;
+			}
+			log(el::LevelHelper::convertToString(message->level()),
+				message->message());
+		}
+};
+
+// ========================== //
+
+// Keeps a logger out of files and the standard output: it is off, or only
+// goes to a log callback
+static void ConfigureLogger(const string& logger_id, bool enabled) {
+	el::Configurations conf;
+	conf.setToDefault();
+	conf.setGlobally(el::ConfigurationType::Enabled, enabled ? "true" : "false");
+	conf.setGlobally(el::ConfigurationType::ToFile, "false");
+	conf.setGlobally(el::ConfigurationType::ToStandardOutput, "false");
+	el::Loggers::reconfigureLogger(el::Loggers::getLogger(logger_id), conf);
+}
+
+// ========================== //
+
+// Registers a logger of its own for a sampler, with its log callback (which
+// must outlive the registration). Only the loggers of the library are
+// configured: the library's own one is turned off, unless the program has
+// registered it. s_log_mutex only guards s_logs, so that the forwarder never
+// waits on it while Easylogging++ waits on the forwarder.
+static string RegisterLogger(const SPPM_Options::Log& log) {
+	static once_flag s_install;
+	call_once(s_install, [] {
+		if (!el::Loggers::hasLogger(SPPM_LOGGER)) ConfigureLogger(SPPM_LOGGER, false);
+		el::Helpers::installLogDispatchCallback<LogForwarder>("sppm_sampler");
+	});
+
+	string logger_id;
+	{
+		lock_guard<mutex> lock(s_log_mutex);
+		logger_id = "sppm_sampler_" + to_string(++s_num_loggers);
+		if (log) s_logs[logger_id] = &log;
+	}
+	ConfigureLogger(logger_id, static_cast<bool>(log));
+	return logger_id;
+}
+
+// ========================== //
+
+static void UnregisterLogger(const string& logger_id) {
+	{
+		lock_guard<mutex> lock(s_log_mutex);
+		s_logs.erase(logger_id);
+	}
+	el::Loggers::unregisterLogger(logger_id);
+}
+
+// ========================== //
+
+// The graph the sampler runs on and the sampler, which holds its samples
+// through a CallbackSink and logs through a logger of its own
+struct SPPM_Sampler::Impl {
+	lemon::SmartGraph graph;
+	lemon::SmartGraph::NodeMap<long long> node_id;
+	lemon::SmartGraph::NodeMap<Util::AttrMap> node_attribute;
+	SPPM_Options options;
+	Callback callback;
+	string logger_id;
+	bool started;
+	int iteration;
+
+	unique_ptr<SPPM> sppm;
+
+	explicit Impl(const SPPM_Options& opts)
+		: node_id(graph), node_attribute(graph), options(opts), started(false),
+		  iteration(0) {
+		logger_id = RegisterLogger(options.log);
+	}
+
+	// The sampler logs until it is destroyed: its logger goes last
+	~Impl() {
+		if (started) sppm->Finish();
+		sppm.reset();
+		UnregisterLogger(logger_id);
+	}
+};
+
+// ========================== //
+
+// Builds the graph of the view, checking that it is well formed
+static void BuildGraph(const SPPM_GraphView& view, lemon::SmartGraph& graph,
+	lemon::SmartGraph::NodeMap<long long>& node_id) {
+
+	if (view.num_nodes < 1 || !view.offsets || !view.adjacency) {
+		throw std::invalid_argument("Empty graph");
+	}
+	if (view.offsets[0] != 0) {
+		throw std::invalid_argument("The first offset must be 0");
+	}
+
+	// Every slot gives an edge as (lower end, higher end). Sorted, each edge
+	// must appear exactly twice: once from each of its ends.
+	vector<pair<int, int>> slots;
+	for (int i = 0; i < view.num_nodes; ++i) {
+		if (view.offsets[i + 1] < view.offsets[i]) {
+			throw std::invalid_argument("Offsets must not decrease");
+		}
+		for (int slot = view.offsets[i]; slot < view.offsets[i + 1]; ++slot) {
+			int j = view.adjacency[slot];
+			if (j < 0 || j >= view.num_nodes || j == i) {
+				throw std::invalid_argument("Invalid neighbour " + to_string(j)
+					+ " of node " + to_string(i));
+			}
+			slots.push_back(make_pair(min(i, j), max(i, j)));
+		}
+	}
+	sort(slots.begin(), slots.end());
+	for (size_t k = 0; k < slots.size(); k += 2) {
+		const pair<int, int>& edge = slots[k];
+		string name = to_string(edge.first) + "-" + to_string(edge.second);
+		if (k + 1 == slots.size() || slots[k + 1] != edge) {
+			throw std::invalid_argument("Edge " + name
+				+ " must be listed from both ends");
+		}
+		if (k + 2 < slots.size() && slots[k + 2] == edge) {
+			throw std::invalid_argument("Edge " + name + " is listed more than once");
+		}
+	}
+
+	vector<lemon::SmartGraph::Node> nodes(view.num_nodes);
+	for (int i = 0; i < view.num_nodes; ++i) {
+		nodes[i] = graph.addNode();
+		node_id[nodes[i]] = i;
+	}
+	for (size_t k = 0; k < slots.size(); k += 2) {
+		graph.addEdge(nodes[slots[k].first], nodes[slots[k].second]);
+	}
+}
+
+// ========================== //
+
+static void SetUpSampler(SPPM& sppm, const SPPM_Options& options,
+	const SPPM_Sampler::Callback& callback) {
+	if (options.thinning < 1 || options.burn_in < 0 || options.num_threads < 1) {
+		throw std::invalid_argument("Invalid burn-in, thinning or number of threads");
+	}
+	sppm.SetSampleSink(unique_ptr<Util::SampleSink>(new CallbackSink(callback)));
+	sppm.SetRhoParameters(options.rho_alpha, options.rho_beta);
+	sppm.SetNumThreads(options.num_threads);
+	sppm.SetSeed(options.seed, options.chain);
+	sppm.SetSplitMergeRate(options.split_merge_rate);
+	sppm.SetTreeSampler(options.wilson_trees ? SPPM::kTreeWilson : SPPM::kTreeKruskal);
+	sppm.SetInitialGroups(options.init_groups);
+}
+
+// ==================================================== //
+
+SPPM_Sampler::SPPM_Sampler(Impl* impl) : m_impl(impl) {
+}
+
+// ========================== //
+
+SPPM_Sampler::~SPPM_Sampler() {
+}
+
+// ========================== //
+
+unique_ptr<SPPM_Sampler> SPPM_Sampler::Normal(const SPPM_GraphView& graph,
+	const double* y, double a, double b, double m, double v,
+	const SPPM_Options& options) {
+
+	unique_ptr<Impl> impl(new Impl(options));
+	BuildGraph(graph, impl->graph, impl->node_id);
+
+	SPPM_Normal* sppm = new SPPM_Normal(impl->graph, impl->node_id,
+		impl->node_attribute, impl->logger_id);
+	impl->sppm.reset(sppm);
+	SetUpSampler(*sppm, options, impl->callback);
+	sppm->SetNormalGammaParameters(a, b, m, v);
+	sppm->SetAttributeColumn(vector<double>(y, y + graph.num_nodes));
+	return unique_ptr<SPPM_Sampler>(new SPPM_Sampler(impl.release()));
+}
+
+// ========================== //
+
+unique_ptr<SPPM_Sampler> SPPM_Sampler::Poisson(const SPPM_GraphView& graph,
+	const double* y, const double* e, double a, double b,
+	const SPPM_Options& options) {
+
+	unique_ptr<Impl> impl(new Impl(options));
+	BuildGraph(graph, impl->graph, impl->node_id);
+
+	SPPM_Poisson* sppm = new SPPM_Poisson(impl->graph, impl->node_id,
+		impl->node_attribute, impl->logger_id);
+	impl->sppm.reset(sppm);
+	SetUpSampler(*sppm, options, impl->callback);
+	sppm->SetGammaParameters(a, b);
+	sppm->SetAttributeColumns(vector<double>(y, y + graph.num_nodes),
+		vector<double>(e, e + graph.num_nodes));
+	return unique_ptr<SPPM_Sampler>(new SPPM_Sampler(impl.release()));
+}
+
+// ========================== //
+
+void SPPM_Sampler::SetCallback(const Callback& callback) {
+	m_impl->callback = callback;
+}
+
+// ========================== //
+
+int SPPM_Sampler::Run(int num_iter, double max_seconds) {
+	Impl& impl = *m_impl;
+	if (!impl.started) {
+		impl.sppm->Start(true);
+		impl.started = true;
+	}
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	int count = 0;
+	for (; count < num_iter; ++count) {
+		if (max_seconds > 0) {
+			chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+			if (elapsed.count() >= max_seconds) break;
+		}
+		int iter = ++impl.iteration;
+		impl.sppm->Step(iter, SPPM::Held(iter, impl.options.burn_in,
+			impl.options.thinning));
+	}
+	return count;
+}
+
+// ========================== //
+
+int SPPM_Sampler::Iteration() const {
+	return m_impl->iteration;
+}
+
+// ==================================================== //
@@ -0,0 +1,172 @@
+#ifndef SPPM_SAMPLING_H_
+#define SPPM_SAMPLING_H_
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+
+namespace Util {
+
+// ==================================================== //
+// Random variates used by the sampler. These replace the std distributions,
+// which are rebuilt on every call: the ziggurat (Marsaglia & Tsang, 2000)
+// for the normal, Marsaglia & Tsang's (2000) squeeze method for the gamma,
+// and batched versions that draw one value for each of many groups.
+// ==================================================== //
+
+// Tables for the 128-layer normal ziggurat (built once, in sampling.cc)
+struct ZigguratTables {
+	ZigguratTables();
+	int32_t kn[128];
+	double wn[128];
+	double fn[128];
+};
+
+extern const ZigguratTables kZiggurat;
+
+// ========================== //
+
+// 32 random bits. Engines with a full 32-bit range are used directly, others
+// (e.g. minstd) go through std::uniform_int_distribution.
+template<class URNG>
+inline uint32_t rbits32(URNG& g) {
+	if (g.max() - g.min() == 0xffffffffu) {
+		return static_cast<uint32_t>(g() - g.min());
+	}
+	std::uniform_int_distribution<uint32_t> bits(0, 0xffffffffu);
+	return bits(g);
+}
+
+// ========================== //
+
+// Uniform on the open interval (0, 1)
+template<class URNG>
+inline double runif(URNG& g) {
+	return (rbits32(g) + 0.5) * (1.0 / 4294967296.0);
+}
+
+// ========================== //
+
+// Standard normal by the ziggurat method. The layer index and the sign/value
+// come from two different words, which avoids the correlation of the
+// original single-word version.
+template<class URNG>
+inline double rstdnormal(URNG& g) {
+	const ZigguratTables& z = kZiggurat;
+	const double r = 3.442619855899;
+	while (true) {
+		int32_t hz = static_cast<int32_t>(rbits32(g));
+		int iz = rbits32(g) & 127;
+		if (std::abs(static_cast<int64_t>(hz)) < z.kn[iz]) {
+			return hz * z.wn[iz];
+		}
+
+		// Base strip: sample from the tail
+		if (iz == 0) {
+			double x, y;
+			do {
+				x = -std::log(runif(g)) / r;
+				y = -std::log(runif(g));
+			} while (y + y < x * x);
+			return (hz > 0) ? r + x : -r - x;
+		}
+
+		// Wedge: accept against the density, else start over
+		double x = hz * z.wn[iz];
+		if (z.fn[iz] + runif(g) * (z.fn[iz - 1] - z.fn[iz]) < std::exp(-0.5 * x * x)) {
+			return x;
+		}
+	}
+}
+
+// ========================== //
+
+// Gamma(shape, 1) for shape >= 1, with d = shape - 1/3 and c = 1/sqrt(9d)
+template<class URNG>
+inline double rstdgamma_mt(double d, double c, URNG& g) {
+	while (true) {
+		double x, v;
+		do {
+			x = rstdnormal(g);
+			v = 1.0 + c * x;
+		} while (v <= 0.0);
+		v = v * v * v;
+		double u = runif(g);
+		double x2 = x * x;
+		if (u < 1.0 - 0.0331 * x2 * x2) return d * v;
+		if (std::log(u) < 0.5 * x2 + d * (1.0 - v + std::log(v))) return d * v;
+	}
+}
+
+// ========================== //
+
+// Gamma(shape, 1). Shapes below one are boosted: G(a) = G(a+1) * U^(1/a).
+template<class URNG>
+inline double rstdgamma(double shape, URNG& g) {
+	if (shape < 1.0) {
+		double d = shape + 2.0 / 3.0;
+		double x = rstdgamma_mt(d, 1.0 / std::sqrt(9.0 * d), g);
+		return x * std::pow(runif(g), 1.0 / shape);
+	}
+	double d = shape - 1.0 / 3.0;
+	return rstdgamma_mt(d, 1.0 / std::sqrt(9.0 * d), g);
+}
+
+// ========================== //
+
+template<class URNG>
+double rgamma(double shape, double rate, URNG& g) {
+	return rstdgamma(shape, g) / rate;
+}
+
+// ========================== //
+
+template<class URNG>
+double rbeta(double a, double b, URNG& g) {
+	double x = rstdgamma(a, g);
+	double y = rstdgamma(b, g);
+	return x / (x + y);
+}
+
+// ========================== //
+
+template<class URNG>
+double rnormal(double mean, double prec, URNG& g) {
+	return mean + rstdnormal(g) / std::sqrt(prec);
+}
+
+// ========================== //
+
+// One Gamma(shape[i], rate[i]) draw for each i in [0, count)
+template<class URNG>
+void rgamma_batch(const double* shape, const double* rate, double* out,
+	int count, URNG& g) {
+
+	for (int i = 0; i < count; ++i) {
+		out[i] = rstdgamma(shape[i], g) / rate[i];
+	}
+}
+
+// ========================== //
+
+// One N(mean[i], 1/prec[i]) draw for each i in [0, count)
+template<class URNG>
+void rnormal_batch(const double* mean, const double* prec, double* out,
+	int count, URNG& g) {
+
+	// Draw all the standard normals first, then scale them in a separate,
+	// branch-free loop the compiler can vectorize
+	for (int i = 0; i < count; ++i) {
+		out[i] = rstdnormal(g);
+	}
+	for (int i = 0; i < count; ++i) {
+		out[i] = mean[i] + out[i] / std::sqrt(prec[i]);
+	}
+}
+
+// ==================================================== //
+
+};
+
+#endif // SPPM_SAMPLING_H_
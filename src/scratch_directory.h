@@ -0,0 +1,61 @@
+#ifndef SPPM_SCRATCH_DIRECTORY_H_
+#define SPPM_SCRATCH_DIRECTORY_H_
+
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// ========================== //
+
+// A new directory /tmp/<prefix>.XXXXXX for the chain outputs of the checks
+// and benchmarks, removed (with every file in it) at the end of the object's
+// lifetime. With enter set it is also the working directory meanwhile, for
+// the code that writes to the working directory.
+class ScratchDirectory {
+	public:
+		explicit ScratchDirectory(const std::string& prefix, bool enter = false)
+			: m_entered(false) {
+			std::string pattern = "/tmp/" + prefix + ".XXXXXX";
+			std::vector<char> path(pattern.begin(), pattern.end());
+			path.push_back('\0');
+			if (!mkdtemp(path.data())) return;
+			m_path = path.data();
+			if (!enter) return;
+
+			char cwd[4096];
+			if (getcwd(cwd, sizeof(cwd)) && chdir(m_path.c_str()) == 0) {
+				m_cwd = cwd;
+				m_entered = true;
+			} else {
+				rmdir(m_path.c_str());
+				m_path.clear();
+			}
+		}
+
+		~ScratchDirectory() {
+			if (m_path.empty()) return;
+			if (m_entered && chdir(m_cwd.c_str()) != 0) return;
+			if (DIR* dir = opendir(m_path.c_str())) {
+				while (struct dirent* entry = readdir(dir)) {
+					if (entry->d_name[0] != '.') unlink((m_path + "/" + entry->d_name).c_str());
+				}
+				closedir(dir);
+			}
+			rmdir(m_path.c_str());
+		}
+
+		bool Ok() const { return !m_path.empty(); }
+		const std::string& Path() const { return m_path; }
+
+	private:
+		std::string m_path;
+		std::string m_cwd;
+		bool m_entered;
+};
+
+// ========================== //
+
+#endif // SPPM_SCRATCH_DIRECTORY_H_
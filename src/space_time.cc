@@ -0,0 +1,90 @@
+#include "space_time.h"
+
+#include <fstream>
+#include <stdexcept>
+
+#include "easylogging++.h"
+
+using namespace std;
+using namespace lemon;
+
+// ==================================================== //
+
+SpaceTime::SpaceTime(const SmartGraph& space,
+	const SmartGraph::NodeMap<long long>& region_id,
+	const SmartGraph::NodeMap<Util::AttrMap>& region_attribute, int num_periods)
+
+	: m_space(space), m_region_id(region_id), m_region_attr(region_attribute),
+	  m_num_regions(space.maxNodeId() + 1), m_num_periods(num_periods) {
+
+	if (num_periods < 1) {
+		throw std::invalid_argument("Space-time needs at least one period.");
+	}
+	LOG(INFO) << "== Space-time product: " << m_num_regions << " regions x "
+		<< m_num_periods << " periods";
+}
+
+// ========================== //
+
+void SpaceTime::Build(SmartGraph& graph, SmartGraph::NodeMap<long long>& node_id) const {
+	int num_edges = m_space.maxEdgeId() + 1;
+	int num_nodes = m_num_regions * m_num_periods;
+	graph.reserveNode(num_nodes);
+	graph.reserveEdge(m_num_periods * num_edges + (m_num_periods - 1) * m_num_regions);
+
+	for (int id = 0; id < num_nodes; ++id) {
+		node_id[graph.addNode()] = id;
+	}
+	for (int t = 0; t < m_num_periods; ++t) {
+		for (int e = 0; e < num_edges; ++e) {
+			SmartGraph::Edge edge = m_space.edgeFromId(e);
+			graph.addEdge(graph.nodeFromId(NodeId(m_space.id(m_space.u(edge)), t)),
+				graph.nodeFromId(NodeId(m_space.id(m_space.v(edge)), t)));
+		}
+	}
+	for (int t = 0; t + 1 < m_num_periods; ++t) {
+		for (int i = 0; i < m_num_regions; ++i) {
+			graph.addEdge(graph.nodeFromId(NodeId(i, t)),
+				graph.nodeFromId(NodeId(i, t + 1)));
+		}
+	}
+	LOG(INFO) << " -- Product graph: " << countNodes(graph) << " nodes, "
+		<< countEdges(graph) << " edges";
+}
+
+// ========================== //
+
+vector<double> SpaceTime::Column(const string& name) const {
+	vector<double> column(m_num_regions * m_num_periods, 0.0);
+	for (int t = 0; t < m_num_periods; ++t) {
+		string key = name + "_" + to_string(t + 1);
+		for (SmartGraph::NodeIt u(m_space); u != INVALID; ++u) {
+			const Util::AttrMap& attributes = m_region_attr[u];
+			Util::AttrMap::const_iterator it = attributes.find(key);
+			if (it == attributes.end()) {
+				throw std::invalid_argument("Missing attribute: " + key);
+			}
+			column[NodeId(m_space.id(u), t)] = it->second;
+		}
+	}
+	return column;
+}
+
+// ========================== //
+
+void SpaceTime::WriteIndex(const string& filename) const {
+	LOG(INFO) << " -- Writing the space-time index to '" << filename << "'";
+	ofstream file(filename);
+	file << "node,region,period" << endl;
+	for (int t = 0; t < m_num_periods; ++t) {
+		for (SmartGraph::NodeIt u(m_space); u != INVALID; ++u) {
+			file << NodeId(m_space.id(u), t) << "," << m_region_id[u] << ","
+				<< t + 1 << endl;
+		}
+	}
+	if (!file) {
+		throw std::ios_base::failure("Failed to write the space-time index.");
+	}
+}
+
+// ==================================================== //
@@ -0,0 +1,63 @@
+#ifndef SPPM_SPACE_TIME_H_
+#define SPPM_SPACE_TIME_H_
+
+#include <string>
+#include <vector>
+
+#include <lemon/smart_graph.h>
+
+#include "util.h"
+
+// ========================== //
+
+// Space-time partitioning: the product of a spatial graph of N regions with
+// T periods. Node (i, t) is region i at period t, joined to the neighbours of
+// i at period t and to (i, t - 1) and (i, t + 1). The product is numbered
+// arithmetically:
+//
+//   node (i, t)                       id  t * N + i
+//   spatial edge e at period t        id  t * M + e          (M spatial edges)
+//   temporal edge (i, t)-(i, t + 1)   id  T * M + t * N + i
+//
+// so the region and period of a node need no lookup table. Only the
+// topology is built; the attributes stay with the regions, as T columns
+// (name_1 .. name_T), and are read straight into the likelihood's columns
+// instead of being copied to every period.
+class SpaceTime {
+	public:
+		SpaceTime(const lemon::SmartGraph& space,
+			const lemon::SmartGraph::NodeMap<long long>& region_id,
+			const lemon::SmartGraph::NodeMap<Util::AttrMap>& region_attribute,
+			int num_periods);
+
+		int NumRegions() const { return m_num_regions; }
+		int NumPeriods() const { return m_num_periods; }
+		int NodeId(int region, int period) const {
+			return period * m_num_regions + region;
+		}
+		int Region(int node) const { return node % m_num_regions; }
+		int Period(int node) const { return node / m_num_regions; }
+
+		// Adds the product graph to an empty graph. The node ids of the
+		// product (node_id) are the graph ids.
+		void Build(lemon::SmartGraph& graph,
+			lemon::SmartGraph::NodeMap<long long>& node_id) const;
+
+		// Attribute column over the product nodes, by node id: node (i, t)
+		// takes the attribute "<name>_<t + 1>" of region i
+		std::vector<double> Column(const std::string& name) const;
+
+		// Writes the region id and period (from 1) of every product node
+		void WriteIndex(const std::string& filename) const;
+
+	private:
+		const lemon::SmartGraph& m_space;
+		const lemon::SmartGraph::NodeMap<long long>& m_region_id;
+		const lemon::SmartGraph::NodeMap<Util::AttrMap>& m_region_attr;
+		int m_num_regions;
+		int m_num_periods;
+};
+
+// ========================== //
+
+#endif // SPPM_SPACE_TIME_H_
@@ -1,30 +1,52 @@
 #include "sppm.h"
 
-#include "easylogging++.h"
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "log.h"
+#include "profiler.h"
+#include "trace.h"
 #include <lemon/connectivity.h>
-#include <lemon/kruskal.h>
 
 using namespace std;
 using namespace lemon;
 
+// Components with at least this many nodes get a worker batch of their own
+// (unless the graph is small enough to fit a few of them in a single batch);
+// smaller ones are packed together.
+static const int kMinBatchNodes = 1024;
+
+// Largest split-R-hat at which the ESS stopping rule may stop the run
+static const double kMaxRhat = 1.01;
+
+// Rounds without improvement after which a MAP restart stops
+static const int kMapPatience = 5;
+
 // ==================================================== //
 
 SPPM::SPPM(SmartGraph& G, SmartGraph::NodeMap<long long>& node_id,
-	SmartGraph::NodeMap<Util::AttrMap>& node_attribute)
+	SmartGraph::NodeMap<Util::AttrMap>& node_attribute, const string& logger_id)
 
 	: m_graph(G), m_node_id(node_id), m_node_attr(node_attribute),
-	  m_pi(G), m_tree(G), m_u_group(G), m_v_group(G), m_rho_alpha(2),
-	  m_rho_beta(5)  {
-
-	LOG(INFO) << "== Initializing SPPM";
-	m_pi_file.exceptions( ofstream::failbit | ofstream::badbit );
-	m_tree_file.exceptions( ofstream::failbit | ofstream::badbit );
-	m_rho_file.exceptions( ofstream::failbit | ofstream::badbit );
-
-	for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
-		m_u_group[u] = false;
-		m_v_group[u] = false;
-	}
+	  m_seed(0), m_chain(0), m_iteration(0), m_num_components(0),
+	  m_component(G), m_beta(1.0), m_greedy(false), m_pi(G), m_tree(G),
+	  m_logger_id(logger_id), m_pool(new ThreadPool(1)), m_output(false),
+	  m_sink_names("csv"),
+	  m_rho_alpha(2), m_rho_beta(5),
+	  m_split_merge_rate(0),
+	  m_monitor(1, {"num_groups", "rho", "log_posterior"}),
+	  m_target_ess(0), m_max_seconds(0),
+	  m_best_score(-numeric_limits<double>::infinity()), m_best_groups(0),
+	  m_best_restart(-1), m_init_groups(0), m_init_rho(-1),
+	  m_reference_num_groups(0), m_reference_rho(0), m_num_held(0),
+	  m_tree_sampler(kTreeKruskal), m_csr(G), m_partition_filter(G) {
+
+	SAMPLER_LOG(INFO) << "== Initializing SPPM";
+
+	FindComponents();
+	BuildBatches();
 }
 
 // ========================== //
@@ -35,159 +57,550 @@ SPPM::~SPPM() {
 // ========================== //
 
 void SPPM::SetRhoParameters(double alpha, double beta) {
-	LOG(INFO) << "== Setting parameters: rho ~ Beta(alpha="<< alpha << ", beta=" << beta << ")";
+	SAMPLER_LOG(INFO) << "== Setting parameters: rho ~ Beta(alpha="<< alpha << ", beta=" << beta << ")";
 	m_rho_alpha = alpha;
 	m_rho_beta = beta;
 }
 
 // ========================== //
 
-void SPPM::Run(int num_iter, int burn_in, int step_size) {
-	LOG(INFO) << "== Running SPPM sampler for " << num_iter << " iterations";
-	LOG(INFO) << " -- Burn-in: " << burn_in << " | Step size: " << step_size;
+void SPPM::SetNumThreads(int num_threads) {
+	SAMPLER_LOG(INFO) << "== Using " << num_threads << " worker thread(s)";
+	m_pool.reset(new ThreadPool(num_threads));
+	BuildBatches();
+}
+
+// ========================== //
 
-	// Prepare the outputs
-	PrepareOutput();
+void SPPM::SetSeed(uint64_t seed, uint32_t chain) {
+	SAMPLER_LOG(INFO) << "== Setting seed: " << seed << " (chain " << chain << ")";
+	m_seed = seed;
+	m_chain = chain;
+}
 
-	// Generate and store initial state
-	GenerateInitialState();
-	HoldSample();
+// ========================== //
+
+void SPPM::SetSplitMergeRate(double rate) {
+	SAMPLER_LOG(INFO) << "== Split-merge proposals per iteration: " << rate;
+	m_split_merge_rate = rate;
+}
+
+// ========================== //
+
+void SPPM::SetTreeSampler(TreeSampler sampler) {
+	SAMPLER_LOG(INFO) << "== Tree sampler: "
+		<< (sampler == kTreeWilson ? "wilson" : "kruskal");
+	m_tree_sampler = sampler;
+}
+
+// ========================== //
+
+void SPPM::SetStoppingRule(double target_ess, double max_seconds) {
+	SAMPLER_LOG(INFO) << "== Stopping rule: target ESS " << target_ess
+		<< " | max seconds " << max_seconds << " (0 = off)";
+	m_target_ess = target_ess;
+	m_max_seconds = max_seconds;
+}
+
+// ========================== //
+
+void SPPM::SetInitialGroups(int num_groups) {
+	if (num_groups > 0) {
+		SAMPLER_LOG(INFO) << "== Initial partition: " << num_groups << " groups (greedy tree cuts)";
+	}
+	m_init_groups = num_groups;
+}
+
+// ========================== //
+
+void SPPM::SetInitialFiles(const string& partition_file, const string& tree_file) {
+	if (partition_file.empty() && tree_file.empty()) return;
+	SAMPLER_LOG(INFO) << "== Reading the initial state";
+	if (!partition_file.empty()) ReadInitialPartition(partition_file, false);
+	if (!tree_file.empty()) ReadInitialTree(tree_file);
+}
+
+// ========================== //
+
+void SPPM::SetOutputDirectory(const string& directory) {
+	SAMPLER_LOG(INFO) << "== Output directory: " << directory;
+	m_output_dir = directory;
+}
+
+// ========================== //
+
+void SPPM::SetShowProgress(bool show) {
+	m_progress.SetConsole(show);
+}
+
+// ========================== //
+
+void SPPM::SetProgress(double interval, const string& metrics_file) {
+	m_progress.SetInterval(interval);
+	m_metrics_file = metrics_file;
+}
+
+// ========================== //
+
+void SPPM::SetPrometheusFile(const string& filename) {
+	m_prometheus_file = filename;
+}
+
+// ========================== //
+
+void SPPM::SetSampleSinks(const string& names) {
+	if (!Util::ValidSinkNames(names)) {
+		throw std::invalid_argument("Invalid sample sinks: '" + names + "'");
+	}
+	m_sink_names = names;
+	m_sink.reset();
+}
+
+// ========================== //
+
+void SPPM::SetSampleSink(unique_ptr<Util::SampleSink> sink) {
+	m_sink_names.clear();
+	m_sink = move(sink);
+}
+
+// ========================== //
+
+string SPPM::OutputPath(const string& filename) const {
+	if (m_output_dir.empty()) return filename;
+	return m_output_dir + "/" + filename;
+}
+
+// ========================== //
+
+void SPPM::SetWarmStart(const string& directory) {
+	SAMPLER_LOG(INFO) << "== Warm start from the run in '" << directory << "'";
+	ReadInitialPartition(directory + "/pi.csv", true);
+	ReadInitialTree(directory + "/tree.csv");
+	ReadInitialRho(directory + "/rho.csv");
+	m_together.assign(m_graph.maxEdgeId() + 1, 0.0);
+	m_num_held = 0;
+}
+
+// ========================== //
+
+Util::Philox SPPM::Stream(uint32_t stream) const {
+	return Util::Philox(m_seed, m_chain, m_iteration, stream);
+}
+
+// ========================== //
+
+void SPPM::FindComponents() {
+	m_num_components = connectedComponents(m_graph, m_component);
+
+	m_component_nodes.assign(m_num_components, vector<SmartGraph::Node>());
+	m_component_edges.assign(m_num_components, vector<SmartGraph::Edge>());
+	m_component_span.assign(m_num_components,
+		make_pair(m_graph.maxNodeId() + 1, 0));
+	for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
+		int comp = m_component[u];
+		m_component_nodes[comp].push_back(u);
+		pair<int, int>& span = m_component_span[comp];
+		span.first = min(span.first, m_graph.id(u));
+		span.second = max(span.second, m_graph.id(u) + 1);
+	}
+	for (SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) {
+		m_component_edges[m_component[m_graph.u(e)]].push_back(e);
+	}
+
+	size_t largest = 0;
+	for (const vector<SmartGraph::Node>& nodes : m_component_nodes) {
+		largest = max(largest, nodes.size());
+	}
+	SAMPLER_LOG(INFO) << " -- Found " << m_num_components << " connected component(s)"
+		<< " (largest has " << largest << " nodes)";
+}
+
+// ========================== //
+
+void SPPM::BuildBatches() {
+	// Aim for a few batches per thread, so the pool can balance them
+	int n = countNodes(m_graph);
+	int target = max(kMinBatchNodes, n / (4 * m_pool->NumThreads()));
+
+	// Largest components first: they are the ones that get a batch alone
+	vector<int> order(m_num_components);
+	for (int comp = 0; comp < m_num_components; ++comp) order[comp] = comp;
+	stable_sort(order.begin(), order.end(), [this](int a, int b) {
+		return m_component_nodes[a].size() > m_component_nodes[b].size();
+	});
+
+	m_batches.clear();
+	int batch_size = target;
+	for (int comp : order) {
+		if (batch_size >= target) {
+			m_batches.push_back(Batch());
+			batch_size = 0;
+		}
+		m_batches.back().components.push_back(comp);
+		batch_size += m_component_nodes[comp].size();
+	}
+
+	size_t num_words = (m_graph.maxNodeId() + 1 + 63) / 64;
+	for (Batch& batch : m_batches) {
+		batch.mask_u.assign(num_words, 0);
+		batch.mask_v.assign(num_words, 0);
+	}
+	SAMPLER_VLOG(2) << " -- Components split in " << m_batches.size() << " batch(es)";
+}
+
+// ========================== //
+
+void SPPM::Run(int num_iter, int burn_in, int step_size) {
+	SAMPLER_LOG(INFO) << "== Running SPPM sampler for " << num_iter << " iterations";
+	SAMPLER_LOG(INFO) << " -- Burn-in: " << burn_in << " | Step size: " << step_size;
+
+	// Prepare the outputs, generate and store initial state
+	Start(true, num_iter);
 
 	// Run the sampler
-	LOG(INFO) << "== Starting now.";
+	SAMPLER_LOG(INFO) << "== Starting now.";
 	for (int iter = 1; iter <= num_iter; ++iter) {
-		VLOG_EVERY_N(num_iter/100, 2) << " -- Iteration " << iter << " of " << num_iter;
-		GetNewSample();
-		if (iter > burn_in && (iter % step_size) == 0) {
-			HoldSample();
+		Step(iter, Held(iter, burn_in, step_size));
+		if (StopRequested()) {
+			SAMPLER_LOG(INFO) << "== Stopping rule met at iteration " << iter;
+			break;
 		}
 	}
-	cout << endl;
-	LOG(INFO) << "== Finished running SPPM sampler";
+	SAMPLER_LOG(INFO) << "== Finished running SPPM sampler";
 
 	// Finish the outputs
-	FinishOutput();
+	Finish();
 }
 
 // ========================== //
 
-void SPPM::PrepareOutput() {
-	LOG(INFO) << "== Preparing outputs";
-	PrepareOutputPartition();
-	PrepareOutputTree();
-	PrepareOutputRho();
-	PrepareOutputTheta();
+void SPPM::Start(bool output, int num_iter) {
+	m_output = output;
+	if (m_output) PrepareOutput();
+	m_monitor = Util::ConvergenceMonitor(1, {"num_groups", "rho", "log_posterior"});
+	m_start_time = chrono::steady_clock::now();
+
+	m_iteration = 0;
+	m_rng = Stream(kStreamMain);
+	GenerateInitialState();
+	if (m_output) {
+		HoldSample();
+		if (!m_metrics_file.empty()) {
+			m_progress.SetMetricsFile(OutputPath(m_metrics_file));
+		}
+		m_progress.SetPrometheusFile(m_prometheus_file, m_chain);
+		m_progress.Start(num_iter, m_max_seconds);
+	}
 }
 
 // ========================== //
 
-void SPPM::FinishOutput() {
-	LOG(INFO) << "== Finishing outputs";
-	FinishOutputPartition();
-	FinishOutputRho();
-	FinishOutputTheta();
-	FinishOutputTree();
+void SPPM::Step(int iteration, bool hold) {
+	m_iteration = iteration;
+	m_rng = Stream(kStreamMain);
+	GetNewSample();
+	if (hold) {
+		HoldSample();
+		UpdateDiagnostics();
+	}
+	if (m_output && m_progress.Due()) m_progress.Report(ProgressNow());
 }
 
 // ========================== //
 
-void SPPM::GenerateInitialState() {
-	LOG(INFO) << "== Generating initial state";
-	GenerateInitialPartition();
-	GenerateInitialRho();
-	GenerateInitialTheta();
-	GenerateInitialTree();
+void SPPM::Finish() {
+	if (m_output) {
+		m_progress.Finish(ProgressNow());
+		ReportDiagnostics();
+		ReportShift();
+		FinishOutput();
+	}
 }
 
 // ========================== //
 
-void SPPM::HoldSample() {
-	VLOG(3) << "== Holding sample (NOT YET IMPLEMENTED)";
-	HoldPartition();
-	HoldRho();
-	HoldTheta();
-	HoldTree();
+bool SPPM::StopRequested() const {
+	if (m_max_seconds > 0) {
+		chrono::duration<double> elapsed = chrono::steady_clock::now() - m_start_time;
+		if (elapsed.count() >= m_max_seconds) return true;
+	}
+	return m_target_ess > 0
+		&& m_monitor.MinEffectiveSampleSize() >= m_target_ess
+		&& m_monitor.MaxSplitRhat() <= kMaxRhat;
 }
 
 // ========================== //
 
-void SPPM::GetNewSample() {
-	VLOG(3) << "== Getting new sample";
-	SamplePartition();
-	SampleRho();
-	SampleTheta();
-	SampleTree();
+double SPPM::LogPosterior() const {
+	int n = countNodes(m_graph);
+	int c = m_num_groups;
+
+	// Given rho every forest edge is cut with probability rho
+	double result = LogLikelihood();
+	result += (c - m_num_components + m_rho_alpha - 1) * log(m_rho);
+	result += (n - c + m_rho_beta - 1) * log(1 - m_rho);
+	return result;
 }
 
 // ========================== //
 
-void SPPM::PrepareOutputPartition() {
-	LOG(INFO) << " -- Preparing output file 'pi.csv'";
-	if (m_pi_file.is_open()) m_pi_file.close();
-	m_pi_file.open("pi.csv", ofstream::out);
-	bool first = true;
-	for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
-		if (first) {
-			m_pi_file << m_node_id[u];
-			first = false;
+double SPPM::LogCollapsedPosterior() const {
+	int n = countNodes(m_graph);
+	int c = m_num_groups;
+	double a = c - m_num_components + m_rho_alpha;
+	double b = n - c + m_rho_beta;
+	return LogLikelihood() + lgamma(a) + lgamma(b) - lgamma(a + b);
+}
+
+// ========================== //
+
+double SPPM::GreedySearch(uint32_t restart, int max_rounds) {
+	// Every restart has its own range of iterations, hence of random
+	// streams, so its result does not depend on which worker runs it
+	uint32_t first = restart * static_cast<uint32_t>(max_rounds + 1);
+	m_output = false;
+	m_greedy = true;
+	m_iteration = first;
+	m_rng = Stream(kStreamMain);
+	GenerateInitialState();
+
+	int n = countNodes(m_graph);
+	vector<long long> best_pi(m_graph.maxNodeId() + 1, 0);
+	double best = -numeric_limits<double>::infinity();
+	int best_groups = 0;
+	int stale = 0;
+	for (int round = 1; round <= max_rounds && stale < kMapPatience; ++round) {
+		m_iteration = first + round;
+		m_rng = Stream(kStreamMain);
+		if (round > 1) SampleTree();
+		SamplePartition();
+
+		// With several components the sweep conditions on rho: take its mode
+		double a = m_num_groups - m_num_components + m_rho_alpha;
+		double b = n - m_num_groups + m_rho_beta;
+		m_rho = min(max((a - 1) / (a + b - 2), 1e-9), 1.0 - 1e-9);
+
+		double score = LogCollapsedPosterior();
+		if (score > best) {
+			best = score;
+			best_groups = m_num_groups;
+			for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
+				best_pi[m_graph.id(u)] = m_pi[u];
+			}
+			stale = 0;
 		}
 		else {
-			m_pi_file << "," << m_node_id[u];
+			stale++;
+		}
+	}
+	m_greedy = false;
+
+	SAMPLER_VLOG(2) << " -- Restart " << restart << ": " << best << " ("
+		<< best_groups << " groups)";
+	if (best > m_best_score) {
+		m_best_score = best;
+		m_best_groups = best_groups;
+		m_best_restart = restart;
+		m_best_pi.swap(best_pi);
+	}
+	return best;
+}
+
+// ========================== //
+
+void SPPM::WriteBestPartition(const string& filename) const {
+	SAMPLER_LOG(INFO) << " -- Writing the best partition (" << m_best_groups
+		<< " groups) to '" << filename << "'";
+	ofstream file(filename);
+	bool first = true;
+	for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
+		if (!first) file << ",";
+		else first = false;
+		file << m_node_id[u];
+	}
+	file << endl;
+	first = true;
+	for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
+		if (!first) file << ",";
+		else first = false;
+		file << m_best_pi[m_graph.id(u)];
+	}
+	file << endl;
+	if (!file) {
+		throw std::ios_base::failure("Failed to write partition to file.");
+	}
+}
+
+// ========================== //
+
+// The state for the progress reports. The output size is what the sinks
+// wrote, buffered bytes included.
+Util::ProgressState SPPM::ProgressNow() {
+	Util::ProgressState state;
+	state.iteration = m_iteration;
+	state.num_groups = m_num_groups;
+	state.rho = m_rho;
+	state.output_bytes = m_sink ? m_sink->BytesWritten() : 0;
+	return state;
+}
+
+// ========================== //
+
+void SPPM::UpdateDiagnostics() {
+	m_monitor.Add(0, {static_cast<double>(m_num_groups), m_rho, LogPosterior()});
+	if (!m_reference_together.empty()) {
+		for (SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) {
+			if (m_pi[m_graph.u(e)] == m_pi[m_graph.v(e)]) m_together[m_graph.id(e)]++;
 		}
+		m_num_held++;
+	}
+	SAMPLER_VLOG_EVERY_N(100, 2) << " -- ESS " << m_monitor.MinEffectiveSampleSize()
+		<< " | split-R-hat " << m_monitor.MaxSplitRhat();
+}
+
+// ========================== //
+
+void SPPM::ReportDiagnostics() const {
+	SAMPLER_LOG(INFO) << "== Convergence diagnostics of the held samples";
+	for (int q = 0; q < m_monitor.NumQuantities(); ++q) {
+		SAMPLER_LOG(INFO) << " -- " << m_monitor.Name(q) << ": ESS = "
+			<< m_monitor.EffectiveSampleSize(q) << " | split-R-hat = "
+			<< m_monitor.SplitRhat(q);
+	}
+}
+
+// ========================== //
+
+// How far the posterior moved from the warm start's run: the change in the
+// probability that the ends of each edge share a group, and in the means
+// of the number of groups and rho
+void SPPM::ReportShift() const {
+	if (m_reference_together.empty() || m_num_held == 0) return;
+	double sum = 0.0, largest = 0.0;
+	int num_flipped = 0, num_edges = 0;
+	for (SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) {
+		int id = m_graph.id(e);
+		double shift = fabs(m_together[id] / m_num_held - m_reference_together[id]);
+		sum += shift;
+		largest = max(largest, shift);
+		if (shift > 0.5) num_flipped++;
+		num_edges++;
 	}
-	m_pi_file << endl;
+	SAMPLER_LOG(INFO) << "== Shift from the warm start's posterior";
+	SAMPLER_LOG(INFO) << " -- P(same group) of the edges: mean change "
+		<< sum / max(num_edges, 1) << " | largest " << largest << " | "
+		<< num_flipped << " of " << num_edges << " changed by more than 0.5";
+	SAMPLER_LOG(INFO) << " -- Mean number of groups: " << m_reference_num_groups
+		<< " -> " << m_monitor.Mean(0);
+	SAMPLER_LOG(INFO) << " -- Mean rho: " << m_reference_rho << " -> " << m_monitor.Mean(1);
+}
+
+// ========================== //
+
+void SPPM::SetInverseTemperature(double beta) {
+	SAMPLER_LOG(INFO) << "== Inverse temperature: " << beta;
+	m_beta = beta;
 }
 
 // ========================== //
 
-void SPPM::PrepareOutputRho() {
-	LOG(INFO) << " -- Preparing output file 'rho.csv'";
-	if (m_rho_file.is_open()) m_rho_file.close();
-	m_rho_file.open("rho.csv", ofstream::out);
-	m_rho_file << "rho" << endl;
+void SPPM::SwapState(SPPM& other) {
+	// The replicas may live on copies of the graph: match nodes and edges by id
+	const SmartGraph& other_graph = other.m_graph;
+	if (m_graph.maxNodeId() != other_graph.maxNodeId()
+			|| m_graph.maxEdgeId() != other_graph.maxEdgeId()) {
+		throw std::invalid_argument("Can not swap states across different graphs.");
+	}
+
+	for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
+		swap(m_pi[u], other.m_pi[other_graph.nodeFromId(m_graph.id(u))]);
+	}
+	for (SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) {
+		SmartGraph::Edge f = other_graph.edgeFromId(m_graph.id(e));
+		bool in_tree = m_tree[e];
+		m_tree[e] = other.m_tree[f];
+		other.m_tree[f] = in_tree;
+	}
+	swap(m_rho, other.m_rho);
+	swap(m_num_groups, other.m_num_groups);
+	SwapTheta(other);
 }
 
 // ========================== //
 
-void SPPM::PrepareOutputTree() {
-	LOG(INFO) << " -- Preparing output file 'tree.csv'";
-	if (m_tree_file.is_open()) m_tree_file.close();
-	m_tree_file.open("tree.csv", ofstream::out);
-	m_tree_file << "U_1,V_1";
-	int curr = 2;
-	while (curr < countNodes(m_graph)) {
-		m_tree_file << ",U_" << curr << ",V_" << curr;
-		++curr;
+void SPPM::PrepareOutput() {
+	SAMPLER_LOG(INFO) << "== Preparing outputs";
+	if (!m_sink_names.empty()) m_sink = Util::CreateSinks(m_sink_names, m_output_dir);
+	if (!m_sink) m_sink.reset(new Util::NullSink());
+
+	Util::SampleHeader header;
+	for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
+		header.node_ids.push_back(m_node_id[u]);
 	}
-	m_tree_file << endl;
+	// A spanning forest has one edge less than nodes per component
+	header.num_tree_edges = countNodes(m_graph) - m_num_components;
+	for (int k = 0; k < NumParams(); ++k) header.param_names.push_back(ParamName(k));
+	m_sink->Open(header);
+}
 
+// ========================== //
+
+void SPPM::FinishOutput() {
+	SAMPLER_LOG(INFO) << "== Finishing outputs";
+	m_sink->Close();
 }
 
 // ========================== //
 
-void SPPM::FinishOutputPartition() {
-	LOG(INFO) << "== Closing output file 'pi.csv'";
-	if (m_pi_file.is_open()) m_pi_file.close();
+void SPPM::GenerateInitialState() {
+	SAMPLER_LOG(INFO) << "== Generating initial state";
+
+	// A given or heuristic partition comes with its tree
+	bool guided = m_init_groups > 0 || !m_init_pi.empty() || !m_init_tree.empty();
+	if (guided) GenerateGuidedState();
+	else GenerateInitialPartition();
+	GenerateInitialRho();
+	GenerateInitialTheta();
+	if (!guided) GenerateInitialTree();
 }
 
 // ========================== //
 
-void SPPM::FinishOutputRho() {
-	LOG(INFO) << "== Closing output file 'rho.csv'";
-	if (m_rho_file.is_open()) m_rho_file.close();
+// Passes the current state to the sinks, through buffers that keep their
+// capacity between samples
+void SPPM::HoldSample() {
+	m_held_labels.clear();
+	for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
+		m_held_labels.push_back(m_pi[u]);
+	}
+	m_held_tree.clear();
+	for (SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) {
+		if (!m_tree[e]) continue;
+		m_held_tree.emplace_back(m_node_id[m_graph.u(e)], m_node_id[m_graph.v(e)]);
+	}
+
+	Util::SampleView sample = {static_cast<int>(m_iteration), m_num_groups, m_rho,
+		m_held_labels, m_held_tree, Theta()};
+	m_sink->Write(sample);
+	SPPM_TRACE_EVENT(Util::kTraceHold, m_iteration, m_held_tree.size());
 }
 
 // ========================== //
 
-void SPPM::FinishOutputTree() {
-	LOG(INFO) << "== Closing output file 'tree.csv'";
-	if (m_tree_file.is_open()) m_tree_file.close();
+void SPPM::GetNewSample() {
+	Util::ScopedTimer timer(Util::kPhaseIteration);
+	SPPM_TRACE_EVENT(Util::kTraceIteration, m_iteration);
+	SamplePartition();
+	SampleSplitMerge();
+	SampleRho();
+	SampleTheta();
+	SampleTree();
 }
 
 // ========================== //
 
 void SPPM::GenerateInitialPartition() {
-	LOG(INFO) << " -- Generating: partition";
+	SAMPLER_LOG(INFO) << " -- Generating: partition";
 	int grp = 0;
 	for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
 		++grp;
@@ -200,129 +613,265 @@ void SPPM::GenerateInitialPartition() {
 
 void SPPM::GenerateInitialRho() {
 	// Generating rho
-	LOG(INFO) << " -- Generating: rho";
+	SAMPLER_LOG(INFO) << " -- Generating: rho";
+	if (m_init_rho > 0) {
+		m_rho = m_init_rho;
+		return;
+	}
 	this->m_rho = Util::rbeta(m_rho_alpha, m_rho_beta, this->m_rng);
 }
 
 // ========================== //
 
 void SPPM::GenerateInitialTree() {
-	LOG(INFO) << " -- Generating: tree";
+	SAMPLER_LOG(INFO) << " -- Generating: tree";
+	if (m_tree_sampler == kTreeWilson) {
+		// A uniform spanning tree of each component
+		vector<long long>& label = m_work.label;
+		label.assign(m_graph.maxNodeId() + 1, 0);
+		for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
+			label[m_graph.id(u)] = m_component[u];
+		}
+		for (SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) m_tree[e] = false;
+		WilsonTrees(label);
+		return;
+	}
+
 	uniform_real_distribution<float> unif(0.0, 1.0);
 
 	// Put random weights on the edges
-	SmartGraph::EdgeMap<float> cost_map(m_graph);
+	m_work.weights.clear();
 	for(SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) {
-		cost_map[e] = unif(m_rng);
+		m_work.weights.push_back(make_pair(unif(m_rng), m_graph.id(e)));
 	}
 
 	// Get a MST by Kruskal's algorithm
-	kruskal(m_graph, cost_map, m_tree);
-
+	KruskalTree();
 }
 
 // ========================== //
 
-void SPPM::HoldPartition() {
-	VLOG(3) << " -- Holding Partition";
-	try {
-		bool first = true;
+// The partition and tree read from files, or the tree cut greedily into
+// m_init_groups groups. Burn-in then starts close to a typical state
+// instead of from n singletons.
+void SPPM::GenerateGuidedState() {
+	if (!m_init_tree.empty()) {
+		SAMPLER_LOG(INFO) << " -- Generating: tree (from file)";
+		for (SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) {
+			m_tree[e] = m_init_tree[m_graph.id(e)];
+		}
+	}
+
+	if (!m_init_pi.empty()) {
+		SAMPLER_LOG(INFO) << " -- Generating: partition (from file)";
 		for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
-			if (first) {
-				m_pi_file << m_pi[u];
-				first = false;
-			}
-			else {
-				m_pi_file << "," << m_pi[u];
-			}
+			m_pi[u] = m_init_pi[m_graph.id(u)];
 		}
-		m_pi_file << endl;
-	} catch (...) {
-		throw std::ios_base::failure("Failed to write partition to file.");
+		if (m_init_tree.empty()) {
+			// Groups must be connected for a tree to keep them
+			RelabelGroups(false);
+			SampleTree();
+		}
+	}
+	else if (m_init_groups > 0) {
+		SAMPLER_LOG(INFO) << " -- Generating: partition (greedy tree cuts)";
+		if (m_init_tree.empty()) GenerateDissimilarityTree();
+		for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
+			m_pi[u] = m_component[u] + 1;
+		}
+		m_num_groups = m_num_components;
+		GreedyCuts(m_init_groups);
+	}
+	else {
+		GenerateInitialPartition();
 	}
+
+	// The groups are the pieces of the tree within each label
+	RelabelGroups(true);
+	SAMPLER_LOG(INFO) << " -- Initial state: " << m_num_groups << " groups";
 }
 
 // ========================== //
 
-void SPPM::HoldRho() {
-	VLOG(3) << " -- Holding Rho";
-	try {
-		m_rho_file << m_rho << endl;
-	} catch (...) {
-		throw std::ios_base::failure("Failed to write partition to file.");
+// Reads a partition file in the format of pi.csv: a header with the node ids
+// and rows with the group of each node. The last row is the initial
+// partition. With a reference, the rows are the samples of a previous run
+// (the first one is its initial state, and is skipped): the fraction of them
+// in which the ends of each edge share a group, and the mean number of
+// groups, are kept.
+void SPPM::ReadInitialPartition(const string& filename, bool reference) {
+	SAMPLER_LOG(INFO) << " -- Reading partition file: " << filename;
+	ifstream file(filename);
+	string line;
+	if (!getline(file, line)) {
+		throw std::ios_base::failure("Failed to read partition file: " + filename);
 	}
-}
-
-// ========================== //
 
-void SPPM::HoldTree() {
-	VLOG(3) << " -- Holding Tree";
-	int count = 0;
-	try {
-		bool first = true;
-		for (SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) {
-			if (!m_tree[e]) continue;
+	unordered_map<long long, SmartGraph::Node> node_of;
+	for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) node_of[m_node_id[u]] = u;
+	vector<int> column_node;
+	istringstream header(line);
+	string field;
+	while (getline(header, field, ',')) {
+		auto it = node_of.find(stoll(field));
+		if (it == node_of.end()) {
+			throw std::invalid_argument("Unknown node in partition file: " + field);
+		}
+		column_node.push_back(m_graph.id(it->second));
+	}
+	if (static_cast<int>(column_node.size()) != countNodes(m_graph)) {
+		throw std::invalid_argument("Partition file does not cover every node");
+	}
 
-			SmartGraph::Node u = m_graph.u(e);
-			SmartGraph::Node v = m_graph.v(e);
+	vector<long long> label(m_graph.maxNodeId() + 1, 0);
+	vector<double> together(m_graph.maxEdgeId() + 1, 0.0);
+	double sum_groups = 0.0;
+	int num_rows = 0;
+	while (getline(file, line)) {
+		if (line.empty()) continue;
+		istringstream row(line);
+		size_t col = 0;
+		long long num_groups = 0;
+		while (col < column_node.size() && getline(row, field, ',')) {
+			label[column_node[col]] = stoll(field);
+			num_groups = max(num_groups, label[column_node[col++]]);
+		}
+		if (col != column_node.size()) {
+			throw std::invalid_argument("Partition row shorter than its header");
+		}
+		num_rows++;
+		if (!reference || num_rows == 1) continue;
 
-			if (!first) m_tree_file << ",";
-			else first = false;
-			m_tree_file << m_node_id[u] << "," << m_node_id[v];
-			count++;
+		// Groups are labelled 1..c
+		sum_groups += num_groups;
+		for (SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) {
+			if (label[m_graph.id(m_graph.u(e))] == label[m_graph.id(m_graph.v(e))]) {
+				together[m_graph.id(e)] += 1.0;
+			}
 		}
-		m_tree_file << endl;
-	} catch (...) {
-		throw std::ios_base::failure("Failed to write partition to file.");
 	}
-	VLOG(3) << "# Edges written: " << count;
+	if (num_rows == 0) {
+		throw std::ios_base::failure("No partition in file: " + filename);
+	}
+	if (reference && num_rows < 2) {
+		throw std::invalid_argument("No samples in partition file: " + filename);
+	}
+	if (reference) {
+		for (double& fraction : together) fraction /= num_rows - 1;
+		m_reference_together.swap(together);
+		m_reference_num_groups = sum_groups / (num_rows - 1);
+	}
+	m_init_pi.swap(label);
 }
 
 // ========================== //
 
-double SPPM::ComputeLogRatio(FilteredGraph& filtered_graph,
-	SmartGraph::Edge& e) {
-
-	// Some helpers
-	int n = countNodes(filtered_graph);
-	int c = m_num_groups;
+// Reads the last row of a tree file in the format of tree.csv: pairs of node
+// ids, one for each edge of a spanning forest of the graph.
+void SPPM::ReadInitialTree(const string& filename) {
+	SAMPLER_LOG(INFO) << " -- Reading tree file: " << filename;
+	ifstream file(filename);
+	string line, last;
+	if (!getline(file, line)) {
+		throw std::ios_base::failure("Failed to read tree file: " + filename);
+	}
+	while (getline(file, line)) {
+		if (!line.empty()) last = line;
+	}
 
-	// We must keep the filtered graph the same. But we remove the edge from it
-	// in order to find the two groups formed by its removal. So we keep the
-	// status to restore it afterwards
-	bool status = filtered_graph.status(e);
-	filtered_graph.disable(e);
+	unordered_map<long long, SmartGraph::Node> node_of;
+	for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) node_of[m_node_id[u]] = u;
 
-	// Retrieve the nodes from the edge
-	SmartGraph::Node u = m_graph.u(e);
-	SmartGraph::Node v = m_graph.v(e);
+	vector<char> in_tree(m_graph.maxEdgeId() + 1, 0);
+	istringstream row(last);
+	string id_u, id_v;
+	int count = 0;
+	while (getline(row, id_u, ',') && getline(row, id_v, ',')) {
+		auto u = node_of.find(stoll(id_u));
+		auto v = node_of.find(stoll(id_v));
+		if (u == node_of.end() || v == node_of.end()) {
+			throw std::invalid_argument("Unknown node in tree file");
+		}
+		SmartGraph::Edge edge = INVALID;
+		for (SmartGraph::IncEdgeIt e(m_graph, u->second); e != INVALID; ++e) {
+			if (m_graph.oppositeNode(u->second, e) == v->second) edge = e;
+		}
+		if (edge == INVALID) {
+			throw std::invalid_argument("Tree edge not in the graph: " + id_u + "-" + id_v);
+		}
+		if (!in_tree[m_graph.id(edge)]) count++;
+		in_tree[m_graph.id(edge)] = 1;
+	}
 
-	// Get the groups we need to compute the ratio
-	FindNodes(filtered_graph, u, m_u_group);
-	FindNodes(filtered_graph, v, m_v_group);
+	// n - k distinct edges that join every component make a spanning forest
+	vector<char> reached(m_graph.maxNodeId() + 1, 0);
+	int num_reached = 0;
+	for (int comp = 0; comp < m_num_components; ++comp) {
+		vector<SmartGraph::Node> queue(1, m_component_nodes[comp][0]);
+		reached[m_graph.id(queue[0])] = 1;
+		for (size_t head = 0; head < queue.size(); ++head) {
+			for (SmartGraph::IncEdgeIt e(m_graph, queue[head]); e != INVALID; ++e) {
+				SmartGraph::Node w = m_graph.oppositeNode(queue[head], e);
+				if (!in_tree[m_graph.id(e)] || reached[m_graph.id(w)]) continue;
+				reached[m_graph.id(w)] = 1;
+				queue.push_back(w);
+			}
+		}
+		num_reached += queue.size();
+	}
+	int n = countNodes(m_graph);
+	if (count != n - m_num_components || num_reached != n) {
+		throw std::invalid_argument("Tree file is not a spanning forest of the graph");
+	}
+	m_init_tree.swap(in_tree);
+}
 
-	// Compute the predictive
-	double log_ratio_pred = ComputeLogRatioPredictive(m_u_group, m_v_group);
+// ========================== //
 
-	// Compute ratio
-	double ratio = log_ratio_pred;
-	ratio += log(n + m_rho_beta - c) - log(c + m_rho_alpha - 2);
+// Reads a rho file in the format of rho.csv: the last value is the initial
+// rho, and the mean of the samples (all but the first) the reference
+void SPPM::ReadInitialRho(const string& filename) {
+	SAMPLER_LOG(INFO) << " -- Reading rho file: " << filename;
+	ifstream file(filename);
+	string line;
+	if (!getline(file, line)) {
+		throw std::ios_base::failure("Failed to read rho file: " + filename);
+	}
+	double sum = 0.0;
+	int count = 0;
+	while (getline(file, line)) {
+		if (line.empty()) continue;
+		m_init_rho = stod(line);
+		if (count++ > 0) sum += m_init_rho;
+	}
+	if (count < 2) {
+		throw std::invalid_argument("No samples in rho file: " + filename);
+	}
+	m_reference_rho = sum / (count - 1);
+}
 
-	// Restore the filtered graph (we disabled the edge, so if it wasn't
-	// initially disabled we must restore it)
-	filtered_graph.status(e, status);
+// ========================== //
 
-	return ratio;
+// Relabels the groups 1..c as the connected pieces of each label, along the
+// tree or along any edge of the graph
+void SPPM::RelabelGroups(bool tree_only) {
+	EdgeFilter same_group(m_graph);
+	for (SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) {
+		same_group[e] = (m_tree[e] || !tree_only)
+			&& m_pi[m_graph.u(e)] == m_pi[m_graph.v(e)];
+	}
+	auto filtered_graph = filterEdges(m_graph, same_group);
+	UpdatePi(filtered_graph);
 }
 
 // ========================== //
 
 void SPPM::SamplePartition() {
-	VLOG(3) << " -- Sampling Partition";
+	Util::ScopedTimer timer(Util::kPhaseSamplePartition);
 
 	// Create an edge filter: on top of the tree, add or remove
 	// edges according to the partitions
-	SmartGraph::EdgeMap<bool> partition_filter(m_graph);
+	EdgeFilter& partition_filter = m_partition_filter;
 	for (SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) {
 		SmartGraph::Node u = m_graph.u(e);
 		SmartGraph::Node v = m_graph.v(e);
@@ -333,64 +882,46 @@ void SPPM::SamplePartition() {
 	}
 
 	// Create an adaptor from the filter we defined
-	auto tree_graph = filterEdges(m_graph, m_tree);
 	auto filtered_graph = filterEdges(m_graph, partition_filter);
 
-	// For each edge, remove it or leave it.
-	uniform_real_distribution<double> coin_toss(0.0, 1.0);
-	for(FilteredGraph::EdgeIt e(tree_graph); e != INVALID; ++e) {
-		bool was_there = filtered_graph.status(e);
-		double log_ratio = ComputeLogRatio(filtered_graph, e);
-		double coin = coin_toss(m_rng);
-		if (log_ratio >= log((1.0 - coin) / coin)) {
-			// Keep Edge
-			partition_filter[e] = true;
-			if (!was_there) m_num_groups--;
+	// Sweep the components. Each batch of components goes to one worker.
+	m_pool->ParallelFor(m_batches.size(), [&](int b) {
+		Batch& batch = m_batches[b];
+		for (int comp : batch.components) {
+			SweepComponent(filtered_graph, comp, batch);
 		}
-		else {
-			// Remove Edge
-			partition_filter[e] = false;
-			if (was_there) m_num_groups++;
-		}
-	}
+	});
 
 	// Update the partition map
-	int new_c = UpdatePi(filtered_graph);
-	cout << "_(" << new_c << ")_" << flush;
+	UpdatePi(filtered_graph);
+	SPPM_TRACE_EVENT(Util::kTraceSweep, m_num_groups);
 }
 
 // ========================== //
 
 
-void SPPM::FindNodes(FilteredGraph& fg, SmartGraph::Node& s, SmartGraph::NodeMap<bool>& nodes) {
-
-	for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
-		nodes[u] = false;
-	}
-
-	Bfs<FilteredGraph> bfs(fg);
-	bfs.init();
-	bfs.addSource(s);
-	while (!bfs.emptyQueue()) {
-		FilteredGraph::Node u = bfs.processNextNode();
-		nodes[u] = true;
-	}
-
-}
-
-// ========================== //
-
 int SPPM::UpdatePi(FilteredGraph& fg) {
+	Util::ScopedTimer timer(Util::kPhaseUpdatePi);
+	// Label the connected components of the filtered graph in the order of
+	// their first node; 0 marks the nodes not reached yet
 	long long group_id = 0;
-	Bfs<FilteredGraph> bfs(fg);
-	bfs.init();
+	vector<SmartGraph::Node>& queue = m_work.queue;
+	for (FilteredGraph::NodeIt n(fg); n != INVALID; ++n) m_pi[n] = 0;
 	for (FilteredGraph::NodeIt n(fg); n != INVALID; ++n) {
-		if (!bfs.reached(n)) {
-			++group_id;
-			bfs.addSource(n);
-			while (!bfs.emptyQueue()) {
-				FilteredGraph::Node u = bfs.processNextNode();
-				m_pi[u] = group_id;
+		if (m_pi[n] != 0) continue;
+		++group_id;
+		m_pi[n] = group_id;
+		queue.clear();
+		queue.push_back(n);
+		for (size_t head = 0; head < queue.size(); ++head) {
+			SmartGraph::Node u = queue[head];
+			for (SmartGraph::IncEdgeIt e(m_graph, u); e != INVALID; ++e) {
+				if (!fg.status(e)) continue;
+				SmartGraph::Node v = m_graph.oppositeNode(u, e);
+				if (m_pi[v] == 0) {
+					m_pi[v] = group_id;
+					queue.push_back(v);
+				}
 			}
 		}
 	}
@@ -402,40 +933,238 @@ int SPPM::UpdatePi(FilteredGraph& fg) {
 
 // ========================== //
 
+// The single edge flips of the sweep already merge and split groups one at a
+// time, but moving the boundary between two neighbouring groups takes them
+// through an intermediate state (the two merged, or a third group) that can
+// be very unlikely. This move does it in one step: pick a cut tree edge,
+// merge the two groups it separates and cut the merged subtree again, at an
+// edge drawn from its conditional given the number of groups (which the move
+// keeps, so the prior cancels and only the predictive ratios matter).
+void SPPM::SampleSplitMerge() {
+	Util::ScopedTimer timer(Util::kPhaseSplitMerge);
+	if (m_split_merge_rate <= 0) return;
+
+	// The rate is the expected number of proposals per iteration
+	uniform_real_distribution<double> unif(0.0, 1.0);
+	int num_moves = static_cast<int>(m_split_merge_rate);
+	if (unif(m_rng) < m_split_merge_rate - num_moves) ++num_moves;
+
+	vector<SmartGraph::Edge>& cut_edges = m_work.cut_edges;
+	cut_edges.clear();
+	for (SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) {
+		if (m_tree[e] && m_pi[m_graph.u(e)] != m_pi[m_graph.v(e)]) {
+			cut_edges.push_back(e);
+		}
+	}
+	if (cut_edges.empty()) return;
+
+	// A move swaps the chosen cut edge for the new one
+	int moved = 0;
+	uniform_int_distribution<size_t> pick(0, cut_edges.size() - 1);
+	for (int i = 0; i < num_moves; ++i) {
+		if (ProposeResplit(cut_edges[pick(m_rng)])) moved++;
+	}
+	SPPM_TRACE_EVENT(Util::kTraceSplitMerge, moved, num_moves);
+}
+
+// ========================== //
+
 void SPPM::SampleRho() {
-	VLOG(3) << " -- Sampling Rho";
+	Util::ScopedTimer timer(Util::kPhaseSampleRho);
 	int n = countNodes(m_graph);
 	int c = m_num_groups;
 
-	double alpha = m_rho_alpha + (c - 1);
+	// Each component contributes (size - 1) forest edges, of which the cut
+	// ones separate the groups
+	double alpha = m_rho_alpha + (c - m_num_components);
 	double beta = m_rho_beta + (n - c);
 	m_rho = Util::rbeta(alpha, beta, m_rng);
 
-	VLOG(4) << "  + New rho: " << m_rho;
+	SPPM_TRACE_EVENT(Util::kTraceRho, alpha, beta, m_rho);
 }
 
 // ========================== //
 
 void SPPM::SampleTree() {
-	VLOG(3) << " -- Sampling Tree";
+	Util::ScopedTimer timer(Util::kPhaseSampleTree);
+	SPPM_TRACE_EVENT(Util::kTraceTree, m_num_groups);
+	if (m_tree_sampler == kTreeWilson) {
+		// Given the partition, the tree is uniform among the trees in which
+		// every group is a subtree: a uniform spanning tree of each group,
+		// joined by a uniform spanning tree of the multigraph of the groups
+		vector<long long>& label = m_work.label;
+		label.assign(m_graph.maxNodeId() + 1, 0);
+		for (SmartGraph::NodeIt u(m_graph); u != INVALID; ++u) {
+			label[m_graph.id(u)] = m_pi[u];
+		}
+		for (SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) m_tree[e] = false;
+		WilsonTrees(label);
+		WilsonGroupTree(label);
+		return;
+	}
+
 	uniform_real_distribution<float> low_unif(0.0, 1.0);
 	uniform_real_distribution<float> high_unif(5.0, 10.0);
 
 	// Add the weights
-	SmartGraph::EdgeMap<float> cost_map(m_graph);
+	m_work.weights.clear();
 	for(SmartGraph::EdgeIt e(m_graph); e != INVALID; ++e) {
 		int p_u = m_pi[m_graph.u(e)];
 		int p_v = m_pi[m_graph.v(e)];
+		float cost;
 		if (p_u == p_v) {
-			cost_map[e] = low_unif(m_rng);
+			cost = low_unif(m_rng);
 		}
 		else {
-			cost_map[e] = high_unif(m_rng);
+			cost = high_unif(m_rng);
 		}
+		m_work.weights.push_back(make_pair(cost, m_graph.id(e)));
 	}
 
 	// Compute the MST through Kruskal
-	kruskal(m_graph, cost_map, m_tree);
+	KruskalTree();
+}
+
+// ========================== //
+
+// Root of u in the union-find forest, halving the path on the way
+static int FindRoot(vector<int>& parent, int u) {
+	while (parent[u] != u) {
+		parent[u] = parent[parent[u]];
+		u = parent[u];
+	}
+	return u;
+}
+
+// ========================== //
+
+// Kruskal's algorithm on the (weight, edge id) pairs in m_work.weights: the
+// minimum spanning forest is written to m_tree (ties go to the lower id)
+void SPPM::KruskalTree() {
+	vector<pair<float, int>>& weights = m_work.weights;
+	sort(weights.begin(), weights.end());
+
+	vector<int>& parent = m_work.parent;
+	parent.resize(m_graph.maxNodeId() + 1);
+	for (size_t u = 0; u < parent.size(); ++u) parent[u] = u;
+
+	for (const pair<float, int>& w : weights) {
+		SmartGraph::Edge e = m_graph.edgeFromId(w.second);
+		int root_u = FindRoot(parent, m_graph.id(m_graph.u(e)));
+		int root_v = FindRoot(parent, m_graph.id(m_graph.v(e)));
+		m_tree[e] = root_u != root_v;
+		if (root_u != root_v) parent[root_u] = root_v;
+	}
+}
+
+// ========================== //
+
+// Wilson's algorithm: a uniform spanning tree of every set of nodes with the
+// same label (each set must be connected) by loop-erased random walks that
+// only step inside the set. The tree edges are added to m_tree.
+void SPPM::WilsonTrees(const vector<long long>& label) {
+	// Labels are component ids or groups, so at most max(k, c)
+	int num_nodes = m_csr.NumNodes();
+	vector<int>& exit_slot = m_work.exit_slot;
+	vector<char>& in_tree = m_work.in_tree;
+	vector<char>& rooted = m_work.rooted;
+	exit_slot.assign(num_nodes, -1);
+	in_tree.assign(num_nodes, 0);
+	rooted.assign(max<long long>(m_num_components, m_num_groups) + 1, 0);
+
+	for (SmartGraph::NodeIt s(m_graph); s != INVALID; ++s) {
+		int start = m_graph.id(s);
+		if (!rooted[label[start]]) {
+			rooted[label[start]] = 1;
+			in_tree[start] = 1;
+			continue;
+		}
+
+		// Walk until the tree is hit. Only the last exit from each node is
+		// kept, which erases the loops.
+		int u = start;
+		while (!in_tree[u]) {
+			int slot;
+			do {
+				slot = RandomSlot(m_csr.Begin(u), m_csr.End(u));
+			} while (label[m_csr.Target(slot)] != label[u]);
+			exit_slot[u] = slot;
+			u = m_csr.Target(slot);
+		}
+
+		// Add the loop-erased path to the tree
+		for (u = start; !in_tree[u]; u = m_csr.Target(exit_slot[u])) {
+			in_tree[u] = 1;
+			m_tree[m_graph.edgeFromId(m_csr.EdgeId(exit_slot[u]))] = true;
+		}
+	}
+}
+
+// ========================== //
+
+// Wilson's algorithm on the multigraph of the groups, which has one edge for
+// every graph edge between two groups. The edges of a uniform spanning tree
+// of it (one per component) are added to m_tree, joining the group trees.
+void SPPM::WilsonGroupTree(const vector<long long>& label) {
+	// Slots leaving each group, bucketed by group (groups are 1..c)
+	int c = m_num_groups;
+	vector<int>& offset = m_work.offset;
+	vector<int>& component = m_work.component;
+	offset.assign(c + 2, 0);
+	component.assign(c + 1, 0);
+	for (SmartGraph::NodeIt s(m_graph); s != INVALID; ++s) {
+		int u = m_graph.id(s);
+		component[label[u]] = m_component[s];
+		for (int slot = m_csr.Begin(u); slot < m_csr.End(u); ++slot) {
+			if (label[m_csr.Target(slot)] != label[u]) offset[label[u] + 1]++;
+		}
+	}
+	for (int g = 0; g <= c; ++g) offset[g + 1] += offset[g];
+	vector<int>& arcs = m_work.arcs;
+	vector<int>& fill = m_work.fill;
+	arcs.resize(offset.back());
+	fill.assign(offset.begin(), offset.end() - 1);
+	for (SmartGraph::NodeIt s(m_graph); s != INVALID; ++s) {
+		int u = m_graph.id(s);
+		for (int slot = m_csr.Begin(u); slot < m_csr.End(u); ++slot) {
+			if (label[m_csr.Target(slot)] != label[u]) arcs[fill[label[u]]++] = slot;
+		}
+	}
+
+	// The first group of each component is its root (the walk buffers of
+	// WilsonTrees are free again)
+	vector<int>& exit_arc = m_work.exit_slot;
+	vector<char>& in_tree = m_work.in_tree;
+	vector<char>& rooted = m_work.rooted;
+	exit_arc.assign(c + 1, -1);
+	in_tree.assign(c + 1, 0);
+	rooted.assign(m_num_components, 0);
+	for (int g = 1; g <= c; ++g) {
+		if (!rooted[component[g]]) {
+			rooted[component[g]] = 1;
+			in_tree[g] = 1;
+			continue;
+		}
+
+		int h = g;
+		while (!in_tree[h]) {
+			int arc = arcs[RandomSlot(offset[h], offset[h + 1])];
+			exit_arc[h] = arc;
+			h = label[m_csr.Target(arc)];
+		}
+		for (h = g; !in_tree[h]; h = label[m_csr.Target(exit_arc[h])]) {
+			in_tree[h] = 1;
+			m_tree[m_graph.edgeFromId(m_csr.EdgeId(exit_arc[h]))] = true;
+		}
+	}
+}
+
+// ========================== //
+
+// Uniform in [begin, end), from a single 32-bit draw
+int SPPM::RandomSlot(int begin, int end) {
+	uint64_t range = end - begin;
+	return begin + static_cast<int>((static_cast<uint64_t>(m_rng()) * range) >> 32);
 }
 
 // ========================== //
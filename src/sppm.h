@@ -1,102 +1,374 @@
 #ifndef SPPM_H_
 #define SPPM_H_
 
+#include <chrono>
+#include <cmath>
+#include <memory>
 #include <random>
+#include <string>
 #include <vector>
 #include <fstream>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 
 #include <lemon/adaptors.h>
 #include <lemon/smart_graph.h>
 
+#include "csr_graph.h"
+#include "diagnostics.h"
+#include "log.h"
+#include "philox.h"
+#include "progress.h"
+#include "sample_sink.h"
+#include "thread_pool.h"
 #include "util.h"
 
 // ========================== //
 
 class SPPM {
 	public:
+		// How spanning trees are drawn: minimum spanning trees of random
+		// weights, or uniform spanning trees by loop-erased random walks
+		enum TreeSampler {
+			kTreeKruskal,
+			kTreeWilson
+		};
+
 		SPPM(lemon::SmartGraph& graph,
 			lemon::SmartGraph::NodeMap<long long>& node_id,
-			lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute);
+			lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute,
+			const std::string& logger_id = SPPM_LOGGER);
 		virtual ~SPPM();
 
 		void SetRhoParameters(double alpha, double beta);
+		void SetNumThreads(int num_threads);
+		void SetSeed(uint64_t seed, uint32_t chain = 0);
+		void SetSplitMergeRate(double rate);
+		void SetTreeSampler(TreeSampler sampler);
+
+		// Stops the run early once every monitored quantity has the target
+		// ESS (and a split-R-hat below kMaxRhat), or after max_seconds of
+		// wall time. Zero disables either rule.
+		void SetStoppingRule(double target_ess, double max_seconds);
+
+		// Initial state. By default the chain starts from singleton groups
+		// on a random spanning tree. The partition and the tree can be read
+		// from files (the last row of a pi.csv or tree.csv), and with
+		// num_groups > 0 the tree (read, or a minimum spanning tree on the
+		// attribute dissimilarity) is cut greedily into that many groups.
+		void SetInitialGroups(int num_groups);
+		void SetInitialFiles(const std::string& partition_file,
+			const std::string& tree_file);
+
+		// Directory the output files are written to (the current one by
+		// default), and whether the progress reports are printed to the
+		// standard output
+		void SetOutputDirectory(const std::string& directory);
+		void SetShowProgress(bool show);
+
+		// Progress reports (see Util::ProgressReporter) every interval
+		// seconds (0 turns them off), also written to metrics_file in the
+		// output directory if it is not empty
+		void SetProgress(double interval, const std::string& metrics_file);
+
+		// The progress reports also rewrite this file (if not empty) in the
+		// Prometheus text format, labelled with the chain id
+		void SetPrometheusFile(const std::string& filename);
+
+		// Where the held samples go (see Util::SampleSink): a comma
+		// separated list of sinks writing to the output directory ("csv" by
+		// default), or a sink of the caller. Throws std::invalid_argument
+		// for an unknown sink name.
+		void SetSampleSinks(const std::string& names);
+		void SetSampleSink(std::unique_ptr<Util::SampleSink> sink);
+
+		// Warm start from a previous run on the same map (its output files
+		// in directory): it continues from its final partition, tree and
+		// rho, and the shift from its posterior is logged at the end
+		void SetWarmStart(const std::string& directory);
 
 		void Run(int num_iter, int burn_in, int step_size);
 
+		// The steps of Run(), for drivers that run several chains: Start()
+		// draws the initial state (and, with output, opens the files, holds
+		// it and starts the progress reports of num_iter iterations), Step()
+		// runs one iteration and Finish() closes the files
+		void Start(bool output, int num_iter = 0);
+		void Step(int iteration, bool hold);
+		void Finish();
+		bool StopRequested() const;
+
+		// Tempering: the likelihood is raised to beta (1 is the posterior)
+		void SetInverseTemperature(double beta);
+
+		// Whether the sample of an iteration is held: every thinning-th
+		// iteration after the burn-in
+		static bool Held(int iteration, int burn_in, int thinning) {
+			return iteration > burn_in && iteration % thinning == 0;
+		}
+
+		// The group parameters: their names and theta[k][g], the k-th
+		// parameter of group g (1..number of groups)
+		virtual int NumParams() const = 0;
+		virtual const char* ParamName(int k) const = 0;
+		virtual const std::vector<std::vector<double>>& Theta() const = 0;
+
+		// Log likelihood of the current partition, theta integrated out
+		virtual double LogLikelihood() const = 0;
+
+		// Log posterior of the current partition, tree and rho, up to a
+		// constant (the tree prior is uniform)
+		double LogPosterior() const;
+
+		// MAP search (see MapSearch). One restart of a greedy ascent from a
+		// new initial state: each round redraws the tree given the partition
+		// and sets every tree edge to its more probable state, until
+		// kMapPatience rounds in a row do not improve (or max_rounds). The
+		// best partition over all the restarts is kept. Returns the score of
+		// this restart: the log posterior with rho and theta integrated out.
+		double GreedySearch(uint32_t restart, int max_rounds);
+		double BestScore() const { return m_best_score; }
+		int BestRestart() const { return m_best_restart; }
+		void WriteBestPartition(const std::string& filename) const;
+
+		// Log posterior of the partition, rho and theta integrated out, up
+		// to a constant
+		double LogCollapsedPosterior() const;
+
+		// Exchanges the states (partition, tree, rho, theta) of two samplers
+		// of the same model, on the same graph or on copies of it with the
+		// same node and edge ids. The samplers can not share a graph if they
+		// run concurrently (LEMON maps register with their graph).
+		void SwapState(SPPM& other);
+
 	protected:
 		typedef std::unordered_set<lemon::SmartGraph::Node> NodeSet;
 
+		// Logger of the sampler (see log.h)
+		const char* LoggerId() const { return m_logger_id.c_str(); }
+
 		lemon::SmartGraph& m_graph;
 		lemon::SmartGraph::NodeMap<long long>& m_node_id;
 		lemon::SmartGraph::NodeMap<Util::AttrMap>& m_node_attr;
 
-		std::default_random_engine m_rng;
+		// Random streams. Every draw comes from a Philox stream keyed by
+		// (seed, chain, iteration, stream id), so parallel stages draw without
+		// sharing state and a run does not depend on the number of threads.
+		// m_rng is the serial stream of the current iteration.
+		enum StreamKind {
+			kStreamMain = 0,
+			kStreamTheta = 1 << 24,
+			kStreamComponent = 2 << 24
+		};
+		uint64_t m_seed;
+		uint32_t m_chain;
+		uint32_t m_iteration;
+		Util::Philox m_rng;
+
+		Util::Philox Stream(uint32_t stream) const;
 
 		int m_num_groups;
 
+		// Connected components of the graph (found once, at construction)
+		int m_num_components;
+		lemon::SmartGraph::NodeMap<int> m_component;
+
+		// Nodes and edges of each component (edges in the graph iteration order)
+		std::vector<std::vector<lemon::SmartGraph::Node>> m_component_nodes;
+		std::vector<std::vector<lemon::SmartGraph::Edge>> m_component_edges;
+
+		// Inverse temperature of the likelihood
+		double m_beta;
+
+		// Set during a MAP search: the sweep takes the more probable state of
+		// each edge instead of drawing it
+		bool m_greedy;
+
 		// Current state
 		double m_rho;
 		lemon::SmartGraph::NodeMap<long long> m_pi;
 		lemon::SmartGraph::EdgeMap<bool> m_tree;
 
+		// The partition filter is written concurrently by the workers (each
+		// one on the edges of its own components), so it can not be a packed
+		// bool map.
+		typedef lemon::SmartGraph::EdgeMap<char> EdgeFilter;
+		typedef lemon::FilterEdges<const lemon::SmartGraph, EdgeFilter> FilteredGraph;
+
+		// Range of node ids [first, last + 1) spanned by each component
+		std::vector<std::pair<int, int>> m_component_span;
+
+		// A group of whole connected components swept by a single worker.
+		// Large components get a batch of their own, small islands are packed
+		// together. Each batch has its own search workspace: a node queue
+		// and one visit bitmask (by node id) for each side of the edge being
+		// evaluated. The masks are cleared after every edge.
+		struct Batch {
+			std::vector<int> components;
+			std::vector<lemon::SmartGraph::Node> queue;
+			std::vector<uint64_t> mask_u;
+			std::vector<uint64_t> mask_v;
+		};
+
+		// Path of an output file
+		std::string OutputPath(const std::string& filename) const;
+
+		// Log prior ratio of keeping a tree edge against cutting it, given
+		// the number of groups with the edge cut
+		double LogPriorRatio(int num_groups) const;
+
 	private:
-		typedef lemon::FilterEdges<const lemon::SmartGraph> FilteredGraph;
+		std::string m_logger_id;
+		std::vector<Batch> m_batches;
+		std::unique_ptr<ThreadPool> m_pool;
 
-		// Helper stuff
-		lemon::SmartGraph::NodeMap<bool> m_u_group;
-		lemon::SmartGraph::NodeMap<bool> m_v_group;
+		// Output files (only used when m_output is set)
+		bool m_output;
+		std::string m_output_dir;
+		std::string m_metrics_file;
+		std::string m_prometheus_file;
 
-		// Output files
-		std::ofstream m_pi_file;
-		std::ofstream m_tree_file;
-		std::ofstream m_rho_file;
+		// Sinks of the held samples (created from m_sink_names by
+		// PrepareOutput, unless given) and the buffers of the view passed
+		// to them: the labels in node order and the tree edges as node id
+		// pairs (theta is passed as it is)
+		std::string m_sink_names;
+		std::unique_ptr<Util::SampleSink> m_sink;
+		std::vector<long long> m_held_labels;
+		std::vector<std::pair<long long, long long>> m_held_tree;
+
+		// Progress of the run (only reported when m_output is set)
+		Util::ProgressReporter m_progress;
 
 		// Parameters
 		double m_rho_alpha;
 		double m_rho_beta;
 
+		// Expected number of split-merge proposals per iteration
+		double m_split_merge_rate;
+
+		// Online diagnostics of the held samples (number of groups, rho and
+		// log posterior) and the stopping rule
+		Util::ConvergenceMonitor m_monitor;
+		double m_target_ess;
+		double m_max_seconds;
+		std::chrono::steady_clock::time_point m_start_time;
+
+		// Best partition (by node id) found by GreedySearch
+		std::vector<long long> m_best_pi;
+		double m_best_score;
+		int m_best_groups;
+		int m_best_restart;
+
+		// Initial state options (see SetInitialGroups): the partition (by
+		// node id) and tree (by edge id) read from files, if any, and rho
+		// (negative if not given)
+		int m_init_groups;
+		std::vector<long long> m_init_pi;
+		std::vector<char> m_init_tree;
+		double m_init_rho;
+
+		// Warm start reference: the posterior of the previous run (fraction
+		// of samples with the ends of each edge in the same group, means of
+		// c and rho) and the same fractions counted in this run
+		std::vector<double> m_reference_together;
+		double m_reference_num_groups;
+		double m_reference_rho;
+		std::vector<double> m_together;
+		int m_num_held;
+
+		// Tree sampler, and the adjacency its random walks run on
+		TreeSampler m_tree_sampler;
+		CSRGraph m_csr;
+
+		// Buffers of the per-iteration updates, kept across iterations so
+		// that a chain stops allocating once they have grown to size: the
+		// partition filter of the sweep, the search queue of UpdatePi, the
+		// weights and union-find of the Kruskal trees, the walk state of the
+		// Wilson trees and the cut edges of the split-merge moves
+		struct Workspace {
+			std::vector<lemon::SmartGraph::Node> queue;
+			std::vector<std::pair<float, int>> weights;
+			std::vector<int> parent;
+			std::vector<long long> label;
+			std::vector<int> exit_slot;
+			std::vector<char> in_tree;
+			std::vector<char> rooted;
+			std::vector<int> offset;
+			std::vector<int> component;
+			std::vector<int> arcs;
+			std::vector<int> fill;
+			std::vector<lemon::SmartGraph::Edge> cut_edges;
+		};
+		Workspace m_work;
+		EdgeFilter m_partition_filter;
+
+		void FindComponents();
+		void BuildBatches();
+
 		void PrepareOutput();
 		void FinishOutput();
 		void GenerateInitialState();
 		void HoldSample();
 		void GetNewSample();
 
-		void PrepareOutputPartition();
-		void PrepareOutputRho();
-		void PrepareOutputTree();
 		void GenerateInitialPartition();
 		void GenerateInitialRho();
 		void GenerateInitialTree();
-		void FinishOutputPartition();
-		void FinishOutputRho();
-		void FinishOutputTree();
+		void GenerateGuidedState();
+		void ReadInitialPartition(const std::string& filename, bool reference);
+		void ReadInitialTree(const std::string& filename);
+		void ReadInitialRho(const std::string& filename);
+		void RelabelGroups(bool tree_only);
 		void SamplePartition();
+		void SampleSplitMerge();
 		void SampleRho();
 		void SampleTree();
-		void HoldPartition();
-		void HoldRho();
-		void HoldTree();
+
+		Util::ProgressState ProgressNow();
+		void UpdateDiagnostics();
+		void ReportDiagnostics() const;
+		void ReportShift() const;
+
+		void KruskalTree();
+		void WilsonTrees(const std::vector<long long>& label);
+		void WilsonGroupTree(const std::vector<long long>& label);
+		int RandomSlot(int begin, int end);
 
 		//int UpdatePi(const Graph::EdgeFilter& edges);
 		//double ComputeLogRatio(Graph::EdgeFilter& edges, int u, int v);
-		void FindNodes(FilteredGraph& fg, lemon::SmartGraph::Node& s,
-			lemon::SmartGraph::NodeMap<bool>& nodes);
 		int UpdatePi(FilteredGraph& graph);
-		double ComputeLogRatio(FilteredGraph& filtered_graph,
-			lemon::SmartGraph::Edge& e);
 
-		virtual void PrepareOutputTheta() = 0;
-		virtual void FinishOutputTheta() = 0;
+		// Model specific (see SPPM_Model). These are called once per
+		// iteration (once per component for the sweep); everything that runs
+		// per edge lives in the model, where it can be inlined.
+		virtual void SweepComponent(FilteredGraph& filtered_graph,
+			int component, Batch& batch) = 0;
+		virtual bool ProposeResplit(lemon::SmartGraph::Edge& cut) = 0;
+		virtual void GenerateDissimilarityTree() = 0;
+		virtual void GreedyCuts(int num_groups) = 0;
 		virtual void GenerateInitialTheta() = 0;
-		virtual void HoldTheta() = 0;
 		virtual void SampleTheta() = 0;
-		virtual double ComputeLogRatioPredictive(
-			lemon::SmartGraph::NodeMap<bool>& set_u,
-			lemon::SmartGraph::NodeMap<bool>& set_v) = 0;
+		virtual void SwapTheta(SPPM& other) = 0;
 };
 
 // ========================== //
 
+inline double SPPM::LogPriorRatio(int num_groups) const {
+	int n = lemon::countNodes(m_graph);
+	int c = num_groups;
+
+	// On a connected graph rho is integrated out. With several components we
+	// condition on the current rho instead: given rho, the forest edges are
+	// cut independently, so every component can be swept on its own and
+	// SampleRho() couples them back through the cut count.
+	if (m_num_components == 1) {
+		return std::log(n + m_rho_beta - c) - std::log(c + m_rho_alpha - 2);
+	}
+	return std::log(1.0 - m_rho) - std::log(m_rho);
+}
+
+// ========================== //
+
 #endif // SPPM_H_
@@ -0,0 +1,708 @@
+/*
+   Copyright (C) 2014  Leonardo Vilela Teixeira
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   */
+
+// Micro benchmarks for the building blocks of the sampler. Each benchmark
+// prints one line per case with its throughput; the variate benchmarks also
+// check the draws against the exact moments of the distribution (and the
+// normal draws against its CDF), and the kernel and reader benchmarks check
+// their results. Exits with 1 if any check fails. The sampler
+// benchmarks run whole chains (in a scratch directory) and report effective
+// samples per second. The scaling benchmarks run a few iterations on synthetic
+// maps of 1k to 1M nodes and report the throughput of each phase of the
+// sampler (from the profiler timers) and the memory of the map and sampler.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "easylogging++.h"
+#include <gflags/gflags.h>
+#include <lemon/smart_graph.h>
+
+#include "diagnostics.h"
+#include "geojson_reader.h"
+#include "masked_moments.h"
+#include "philox.h"
+#include "profiler.h"
+#include "sampling.h"
+#include "scratch_directory.h"
+#include "sppm_normal.h"
+#include "sppm_poisson.h"
+
+using namespace std;
+
+INITIALIZE_EASYLOGGINGPP
+
+// ========================== //
+
+DEFINE_string(filter, "", "run only the benchmarks whose name contains this");
+DEFINE_uint64(draws, 1000000, "number of draws for the variate benchmarks");
+DEFINE_uint64(work, 50000000, "nodes visited per case in the kernel benchmarks");
+DEFINE_uint64(iterations, 1000, "iterations per chain in the sampler benchmarks");
+DEFINE_uint64(sweeps, 3, "iterations per chain in the scaling benchmarks");
+DEFINE_uint64(max_nodes, 1000000, "largest map in the scaling benchmarks");
+
+static const char USAGE[] =
+R"(
+Usage:
+	sppm_bench [--filter=<name>] [--draws=<n>] [--work=<n>] [--iterations=<n>]
+		[--sweeps=<n>] [--max_nodes=<n>]
+)";
+
+// ========================== //
+
+struct Benchmark {
+	string name;
+	function<void()> run;
+};
+
+static vector<Benchmark>& Registry() {
+	static vector<Benchmark> benchmarks;
+	return benchmarks;
+}
+
+static bool Register(const string& name, function<void()> run) {
+	Registry().push_back(Benchmark{name, run});
+	return true;
+}
+
+// ========================== //
+
+// Checks that failed so far
+static int s_num_failed = 0;
+
+// The verdict printed after a check, counting it if it failed
+static string Verdict(bool ok, const string& failure = "FAIL") {
+	if (!ok) s_num_failed++;
+	return ok ? "ok" : failure;
+}
+
+// ========================== //
+
+template <class F>
+static double Seconds(F f) {
+	auto start = chrono::steady_clock::now();
+	f();
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+// ========================== //
+
+static void Report(const string& name, double seconds, double items,
+	const string& unit, const string& extra = "") {
+
+	cout << "  " << left << setw(36) << name << right
+		<< setw(12) << fixed << setprecision(2) << items / seconds / 1e6
+		<< " M" << unit << "/s" << "  " << extra << endl;
+}
+
+// ========================== //
+
+// Resident memory of the process, in MB
+static double ResidentMegabytes() {
+	ifstream statm("/proc/self/statm");
+	long size = 0, resident = 0;
+	statm >> size >> resident;
+	return resident * static_cast<double>(sysconf(_SC_PAGESIZE)) / (1 << 20);
+}
+
+// ========================== //
+
+// Mean and variance of the draws against the exact ones, as z-scores of the
+// sample mean and variance; the check fails at a |z| of 5 or more
+static string MomentCheck(const vector<double>& x, double mean, double var,
+	double kurt_excess) {
+
+	double n = x.size();
+	double m = 0.0;
+	for (double xi : x) m += xi;
+	m /= n;
+	double s2 = 0.0;
+	for (double xi : x) s2 += (xi - m) * (xi - m);
+	s2 /= (n - 1);
+
+	double z_mean = (m - mean) / sqrt(var / n);
+	double var_of_s2 = var * var * (2.0 / (n - 1) + kurt_excess / n);
+	double z_var = (s2 - var) / sqrt(var_of_s2);
+
+	ostringstream out;
+	bool ok = fabs(z_mean) < 5 && fabs(z_var) < 5;
+	out << setprecision(2) << fixed << "z(mean)=" << setw(6) << z_mean
+		<< " z(var)=" << setw(6) << z_var << "  " << Verdict(ok);
+	return out.str();
+}
+
+// ========================== //
+
+// Kolmogorov-Smirnov distance to the standard normal; the check fails past
+// the critical value
+static string NormalKSCheck(vector<double> x) {
+	sort(x.begin(), x.end());
+	double n = x.size();
+	double d = 0.0;
+	for (size_t i = 0; i < x.size(); ++i) {
+		double cdf = 0.5 * erfc(-x[i] / sqrt(2.0));
+		d = max(d, max(fabs(cdf - i / n), fabs((i + 1) / n - cdf)));
+	}
+	// Critical value at the 0.1% level
+	double critical = 1.95 / sqrt(n);
+	ostringstream out;
+	out << setprecision(5) << fixed << "KS=" << d << " (crit " << critical
+		<< ")  " << Verdict(d < critical);
+	return out.str();
+}
+
+// ==================================================== //
+// Variates
+// ==================================================== //
+
+static bool reg_engines = Register("variates/engines", [] {
+	int n = FLAGS_draws;
+	uint32_t sink = 0;
+
+	minstd_rand0 minstd;
+	double t = Seconds([&] { for (int i = 0; i < n; ++i) sink += minstd(); });
+	Report("std::minstd_rand0", t, n, "words");
+
+	mt19937 mt;
+	t = Seconds([&] { for (int i = 0; i < n; ++i) sink += mt(); });
+	Report("std::mt19937", t, n, "words");
+
+	Util::Philox philox(42);
+	t = Seconds([&] { for (int i = 0; i < n; ++i) sink += philox(); });
+	Report("Util::Philox", t, n, "words");
+
+	// Opening a new stream (e.g. one per component and iteration)
+	t = Seconds([&] {
+		for (int i = 0; i < n; ++i) {
+			Util::Philox stream(42, 0, 1, i);
+			sink += stream();
+		}
+	});
+	Report("Util::Philox (new stream per word)", t, n, "words");
+
+	if (sink == 42) cout << "";
+});
+
+// ========================== //
+
+static bool reg_normal = Register("variates/normal", [] {
+	int n = FLAGS_draws;
+	mt19937 rng(42);
+	vector<double> x(n);
+
+	double t = Seconds([&] {
+		for (int i = 0; i < n; ++i) {
+			normal_distribution<double> normal(0.0, 1.0);
+			x[i] = normal(rng);
+		}
+	});
+	Report("std::normal_distribution", t, n, "draws");
+
+	t = Seconds([&] {
+		for (int i = 0; i < n; ++i) x[i] = Util::rnormal(0.0, 1.0, rng);
+	});
+	Report("Util::rnormal (ziggurat)", t, n, "draws", NormalKSCheck(x));
+
+	vector<double> mean(n, 2.0), prec(n, 4.0);
+	t = Seconds([&] {
+		Util::rnormal_batch(mean.data(), prec.data(), x.data(), n, rng);
+	});
+	Report("Util::rnormal_batch", t, n, "draws",
+		MomentCheck(x, 2.0, 0.25, 0.0));
+});
+
+// ========================== //
+
+static bool reg_gamma = Register("variates/gamma", [] {
+	int n = FLAGS_draws;
+	mt19937 rng(42);
+	vector<double> x(n);
+
+	for (double shape : {0.3, 1.0, 2.5, 10.0, 250.0}) {
+		double rate = 2.0;
+		double mean = shape / rate;
+		double var = shape / (rate * rate);
+		double kurt = 6.0 / shape;
+		ostringstream label;
+		label << "(shape=" << shape << ")";
+
+		double t = Seconds([&] {
+			for (int i = 0; i < n; ++i) {
+				gamma_distribution<double> gamma(shape, 1.0 / rate);
+				x[i] = gamma(rng);
+			}
+		});
+		Report("std::gamma_distribution " + label.str(), t, n, "draws");
+
+		t = Seconds([&] {
+			for (int i = 0; i < n; ++i) x[i] = Util::rgamma(shape, rate, rng);
+		});
+		Report("Util::rgamma " + label.str(), t, n, "draws",
+			MomentCheck(x, mean, var, kurt));
+	}
+
+	// One draw per group, with shapes and rates as SampleTheta produces them
+	vector<double> shape(n), rate(n);
+	for (int i = 0; i < n; ++i) {
+		shape[i] = 1.0 + (i % 500);
+		rate[i] = 1.0 + 0.01 * (i % 500);
+	}
+	double t = Seconds([&] {
+		Util::rgamma_batch(shape.data(), rate.data(), x.data(), n, rng);
+	});
+	Report("Util::rgamma_batch (mixed shapes)", t, n, "draws");
+});
+
+// ========================== //
+
+static bool reg_beta = Register("variates/beta", [] {
+	int n = FLAGS_draws;
+	mt19937 rng(42);
+	vector<double> x(n);
+	double a = 2.0, b = 5.0;
+
+	double t = Seconds([&] {
+		for (int i = 0; i < n; ++i) {
+			gamma_distribution<double> gamma_a(a, 1);
+			gamma_distribution<double> gamma_b(b, 1);
+			double ga = gamma_a(rng);
+			double gb = gamma_b(rng);
+			x[i] = ga / (ga + gb);
+		}
+	});
+	Report("std::gamma_distribution x2", t, n, "draws");
+
+	t = Seconds([&] {
+		for (int i = 0; i < n; ++i) x[i] = Util::rbeta(a, b, rng);
+	});
+	double mean = a / (a + b);
+	double var = a * b / ((a + b) * (a + b) * (a + b + 1));
+	double kurt = 6 * ((a - b) * (a - b) * (a + b + 1) - a * b * (a + b + 2))
+		/ (a * b * (a + b + 2) * (a + b + 3));
+	Report("Util::rbeta", t, n, "draws", MomentCheck(x, mean, var, kurt));
+});
+
+// ==================================================== //
+// Kernels
+// ==================================================== //
+
+static bool reg_masked_moments = Register("kernels/masked_moments", [] {
+	mt19937 rng(42);
+	uniform_real_distribution<double> unif(0.0, 1.0);
+
+	for (size_t n : {1000, 10000, 100000, 1000000}) {
+		// Two disjoint groups of ~30% of the nodes each, scattered
+		vector<double> y(n);
+		vector<char> in_u(n), in_v(n);
+		vector<uint64_t> mask_u((n + 63) / 64), mask_v((n + 63) / 64);
+		for (size_t i = 0; i < n; ++i) {
+			y[i] = 10.0 * unif(rng) - 5.0;
+			double side = unif(rng);
+			in_u[i] = side < 0.3;
+			in_v[i] = side >= 0.3 && side < 0.6;
+			if (in_u[i]) mask_u[i / 64] |= uint64_t(1) << (i % 64);
+			if (in_v[i]) mask_v[i / 64] |= uint64_t(1) << (i % 64);
+		}
+		size_t reps = max<size_t>(1, FLAGS_work / n);
+		ostringstream label;
+		label << "(n=" << n << ")";
+
+		// The loop the sampler used to run: one branchy pass per side
+		Util::Moments ref_u, ref_v;
+		double t = Seconds([&] {
+			for (size_t r = 0; r < reps; ++r) {
+				Util::Moments u, v;
+				for (size_t i = 0; i < n; ++i) {
+					if (!in_u[i]) continue;
+					u.count++;
+					u.sum += y[i];
+					u.sum_sq += y[i] * y[i];
+				}
+				for (size_t i = 0; i < n; ++i) {
+					if (!in_v[i]) continue;
+					v.count++;
+					v.sum += y[i];
+					v.sum_sq += y[i] * y[i];
+				}
+				ref_u = u;
+				ref_v = v;
+			}
+		});
+		Report("two passes, bool map " + label.str(), t, double(n) * reps, "nodes");
+
+		for (const auto& kernel : Util::MaskedMomentsKernels()) {
+			Util::Moments u, v;
+			t = Seconds([&] {
+				for (size_t r = 0; r < reps; ++r) {
+					u = v = Util::Moments();
+					kernel.second(mask_u.data(), mask_v.data(), y.data(), n, &u, &v);
+				}
+			});
+			double error = max(fabs(u.sum_sq - ref_u.sum_sq) / ref_u.sum_sq,
+				fabs(v.sum - ref_v.sum) / (fabs(ref_v.sum) + 1.0));
+			bool ok = u.count == ref_u.count && v.count == ref_v.count
+				&& error < 1e-9;
+			Report("masked, " + kernel.first + " " + label.str(), t,
+				double(n) * reps, "nodes", Verdict(ok, "MISMATCH"));
+		}
+	}
+});
+
+// ==================================================== //
+// Sampler
+// ==================================================== //
+
+// Chain traces of the number of groups and of rho
+struct Trace {
+	vector<double> num_groups;
+	vector<double> rho;
+	double seconds;
+};
+
+// ========================== //
+
+// Runs a Normal chain on a rows x cols lattice whose left and right halves
+// have different means, and reads the traces back from the output files
+static Trace RunLatticeChain(int rows, int cols, double split_merge_rate) {
+	lemon::SmartGraph graph;
+	lemon::SmartGraph::NodeMap<long long> node_id(graph);
+	lemon::SmartGraph::NodeMap<Util::AttrMap> node_attr(graph);
+	vector<lemon::SmartGraph::Node> nodes;
+	mt19937 rng(42);
+	normal_distribution<double> noise(0.0, 1.0);
+	for (int r = 0; r < rows; ++r) {
+		for (int c = 0; c < cols; ++c) {
+			lemon::SmartGraph::Node u = graph.addNode();
+			node_id[u] = r * cols + c;
+			node_attr[u]["Y"] = (c < cols / 2 ? 0.0 : 3.0) + noise(rng);
+			if (c > 0) graph.addEdge(nodes.back(), u);
+			if (r > 0) graph.addEdge(nodes[(r - 1) * cols + c], u);
+			nodes.push_back(u);
+		}
+	}
+
+	SPPM_Normal sppm(graph, node_id, node_attr);
+	sppm.SetAttribute("Y");
+	sppm.SetRhoParameters(2, 8);
+	sppm.SetNormalGammaParameters(1, 1, 0, 1);
+	sppm.SetSeed(7);
+	sppm.SetSplitMergeRate(split_merge_rate);
+
+	// The sampler writes its progress to cout
+	ostringstream progress;
+	streambuf* saved = cout.rdbuf(progress.rdbuf());
+	Trace trace;
+	trace.seconds = Seconds([&] { sppm.Run(FLAGS_iterations, 0, 1); });
+	cout.rdbuf(saved);
+
+	// One line per iteration after the headers (and the initial state)
+	ifstream pi_file("pi.csv"), rho_file("rho.csv");
+	string line;
+	getline(pi_file, line);
+	getline(pi_file, line);
+	while (getline(pi_file, line)) {
+		istringstream fields(line);
+		string label;
+		vector<string> labels;
+		while (getline(fields, label, ',')) labels.push_back(label);
+		sort(labels.begin(), labels.end());
+		double c = unique(labels.begin(), labels.end()) - labels.begin();
+		trace.num_groups.push_back(c);
+	}
+	getline(rho_file, line);
+	getline(rho_file, line);
+	while (getline(rho_file, line)) trace.rho.push_back(stod(line));
+	return trace;
+}
+
+// ========================== //
+
+static bool reg_split_merge = Register("sampler/split_merge", [] {
+	ScratchDirectory scratch("sppm_bench", true);
+	if (!scratch.Ok()) {
+		cout << "  could not create a scratch directory" << endl;
+		return;
+	}
+
+	for (int side : {20, 40}) {
+		for (double rate : {0.0, 1.0, 10.0}) {
+			Trace trace = RunLatticeChain(side, side, rate);
+			double ess_c = Util::EffectiveSampleSize(trace.num_groups);
+			double ess_rho = Util::EffectiveSampleSize(trace.rho);
+			ostringstream label;
+			label << "split-merge (" << side << "x" << side << ", rate=" << rate << ")";
+			cout << "  " << left << setw(36) << label.str() << right << fixed
+				<< setprecision(1) << setw(10) << FLAGS_iterations / trace.seconds
+				<< " iter/s  ESS/s c=" << setw(8) << ess_c / trace.seconds
+				<< " rho=" << setw(8) << ess_rho / trace.seconds << endl;
+		}
+	}
+});
+
+// ==================================================== //
+// Scaling
+// ==================================================== //
+
+// A synthetic map and its attributes, by node id: a normal Y and Poisson
+// counts O with expected counts E, with higher values on the right half
+struct SyntheticMap {
+	lemon::SmartGraph graph;
+	lemon::SmartGraph::NodeMap<long long> node_id;
+	lemon::SmartGraph::NodeMap<Util::AttrMap> node_attr;
+	vector<double> y;
+	vector<double> o;
+	vector<double> e;
+
+	SyntheticMap() : node_id(graph), node_attr(graph) { }
+};
+
+enum MapKind {
+	kMapLattice,
+	kMapPlanar
+};
+
+// ========================== //
+
+// A side x side lattice, or (kMapPlanar) a random planar map: the lattice
+// with one of the two diagonals of every cell, drawn at random
+static void BuildMap(MapKind kind, int side, SyntheticMap& map) {
+	mt19937 rng(42);
+	normal_distribution<double> noise(0.0, 1.0);
+	uniform_real_distribution<double> unif(0.0, 1.0);
+
+	int n = side * side;
+	map.graph.reserveNode(n);
+	map.graph.reserveEdge(kind == kMapPlanar ? 3 * n : 2 * n);
+	vector<lemon::SmartGraph::Node> nodes(n);
+	for (int i = 0; i < n; ++i) {
+		nodes[i] = map.graph.addNode();
+		map.node_id[nodes[i]] = i;
+		bool right = i % side >= side / 2;
+		double expected = 5.0 + 10.0 * unif(rng);
+		poisson_distribution<int> count(expected * (right ? 2.0 : 1.0));
+		map.y.push_back((right ? 3.0 : 0.0) + noise(rng));
+		map.o.push_back(count(rng));
+		map.e.push_back(expected);
+	}
+	for (int r = 0; r < side; ++r) {
+		for (int c = 0; c < side; ++c) {
+			int i = r * side + c;
+			if (c > 0) map.graph.addEdge(nodes[i - 1], nodes[i]);
+			if (r > 0) map.graph.addEdge(nodes[i - side], nodes[i]);
+			if (kind == kMapPlanar && r > 0 && c > 0) {
+				if (unif(rng) < 0.5) map.graph.addEdge(nodes[i - side - 1], nodes[i]);
+				else map.graph.addEdge(nodes[i - side], nodes[i - 1]);
+			}
+		}
+	}
+}
+
+// ========================== //
+
+// Throughput of a profiled phase, in items per call
+static void ReportPhase(const string& name, Util::ProfilePhase phase,
+	double items_per_call, const string& unit, const string& extra = "") {
+
+	uint64_t calls = 0;
+	double seconds = Util::Profiler::TotalSeconds(phase, &calls);
+	if (calls == 0 || seconds <= 0) return;
+	Report(name, seconds, items_per_call * calls, unit, extra);
+}
+
+// ========================== //
+
+// Runs FLAGS_sweeps iterations of each model on a synthetic map (every
+// iteration held, so the writers run too) and reports each phase on its own
+static void RunScaleCase(MapKind kind, int side) {
+	ScratchDirectory scratch("sppm_bench", true);
+	if (!scratch.Ok()) {
+		cout << "  could not create a scratch directory" << endl;
+		return;
+	}
+
+	double base = ResidentMegabytes();
+	SyntheticMap map;
+	double seconds = Seconds([&] { BuildMap(kind, side, map); });
+	double map_mb = ResidentMegabytes() - base;
+	int n = lemon::countNodes(map.graph);
+	int m = lemon::countEdges(map.graph);
+
+	ostringstream size;
+	size << "(n=" << n << ")";
+	ostringstream memory;
+	memory << fixed << setprecision(1) << "map " << map_mb << " MB, "
+		<< m << " edges";
+	Report("build map " + size.str(), seconds, n, "nodes", memory.str());
+
+	for (string model : {"normal", "poisson"}) {
+		base = ResidentMegabytes();
+		unique_ptr<SPPM> sppm;
+		if (model == "normal") {
+			SPPM_Normal* normal = new SPPM_Normal(map.graph, map.node_id, map.node_attr);
+			normal->SetAttributeColumn(map.y);
+			normal->SetNormalGammaParameters(1, 1, 0, 1);
+			sppm.reset(normal);
+		} else {
+			SPPM_Poisson* poisson = new SPPM_Poisson(map.graph, map.node_id, map.node_attr);
+			poisson->SetAttributeColumns(map.o, map.e);
+			poisson->SetGammaParameters(1, 1);
+			sppm.reset(poisson);
+		}
+		sppm->SetRhoParameters(2, 8);
+		sppm->SetSeed(7);
+		sppm->SetShowProgress(false);
+		double sampler_mb = ResidentMegabytes() - base;
+
+		Util::Profiler::Reset();
+		sppm->Run(FLAGS_sweeps, 0, 1);
+		memory.str("");
+		memory << fixed << setprecision(1) << "sampler "
+			<< ResidentMegabytes() - base << " MB (" << sampler_mb << " MB set up)";
+
+		string prefix = model + " ";
+		ReportPhase(prefix + "iteration " + size.str(), Util::kPhaseIteration,
+			n, "nodes", memory.str());
+		ReportPhase(prefix + "partition sweep", Util::kPhaseSamplePartition, m, "edges");
+		ReportPhase(prefix + "UpdatePi", Util::kPhaseUpdatePi, n, "nodes");
+		ReportPhase(prefix + "SampleTree", Util::kPhaseSampleTree, m, "edges");
+		ReportPhase(prefix + "SampleTheta", Util::kPhaseSampleTheta, n, "nodes");
+		ReportPhase(prefix + "write partition", Util::kPhaseHoldPartition, n, "nodes");
+		ReportPhase(prefix + "write tree", Util::kPhaseHoldTree, m, "edges");
+		ReportPhase(prefix + "write theta", Util::kPhaseHoldTheta, n, "nodes");
+	}
+
+	// Reading the state back (the last normal run left its files here)
+	SPPM_Normal reader(map.graph, map.node_id, map.node_attr);
+	seconds = Seconds([&] { reader.SetInitialFiles("pi.csv", "tree.csv"); });
+	Report("read pi.csv and tree.csv", seconds, n, "nodes");
+}
+
+// ========================== //
+
+static vector<int> ScaleSides() {
+	vector<int> sides;
+	for (int side : {32, 100, 317, 1000}) {
+		if (static_cast<uint64_t>(side * side) <= FLAGS_max_nodes) sides.push_back(side);
+	}
+	return sides;
+}
+
+// ========================== //
+
+static bool reg_scale_lattice = Register("scale/lattice", [] {
+	Util::Profiler::Enable();
+	for (int side : ScaleSides()) RunScaleCase(kMapLattice, side);
+	Util::Profiler::Enable(false);
+});
+
+// ========================== //
+
+static bool reg_scale_planar = Register("scale/planar", [] {
+	Util::Profiler::Enable();
+	for (int side : ScaleSides()) RunScaleCase(kMapPlanar, side);
+	Util::Profiler::Enable(false);
+});
+
+// ========================== //
+
+// Loading a GeoJSON map (the reader only needs the ids, properties and
+// neighbour lists, so the features carry no geometry)
+static bool reg_scale_reader = Register("scale/geojson_reader", [] {
+	ScratchDirectory scratch("sppm_bench", true);
+	if (!scratch.Ok()) {
+		cout << "  could not create a scratch directory" << endl;
+		return;
+	}
+
+	for (int side : ScaleSides()) {
+		SyntheticMap map;
+		BuildMap(kMapPlanar, side, map);
+		{
+			ofstream file("map.json");
+			file << "{\"type\": \"FeatureCollection\", \"features\": [\n";
+			for (lemon::SmartGraph::NodeIt u(map.graph); u != lemon::INVALID; ++u) {
+				int id = map.graph.id(u);
+				file << (id == 0 ? "" : ",\n") << "{\"type\": \"Feature\", \"id\": " << id
+					<< ", \"properties\": {\"Y\": " << map.y[id] << ", \"O\": "
+					<< map.o[id] << ", \"E\": " << map.e[id] << "}, \"neighbours\": [";
+				bool first = true;
+				for (lemon::SmartGraph::IncEdgeIt e(map.graph, u); e != lemon::INVALID; ++e) {
+					file << (first ? "" : ", ") << map.graph.id(map.graph.oppositeNode(u, e));
+					first = false;
+				}
+				file << "]}";
+			}
+			file << "\n]}\n";
+		}
+
+		ifstream written("map.json", ios::ate);
+		double file_mb = static_cast<double>(written.tellg()) / (1 << 20);
+		int n = side * side;
+
+		double base = ResidentMegabytes();
+		lemon::SmartGraph graph;
+		lemon::SmartGraph::NodeMap<long long> node_id(graph);
+		lemon::SmartGraph::NodeMap<Util::AttrMap> node_attr(graph);
+		GeoJSONReader reader;
+		bool ok = false;
+		double seconds = Seconds([&] {
+			ok = reader.LoadData("map.json", graph, node_id, node_attr);
+		});
+
+		ostringstream label, extra;
+		label << "GeoJSON (n=" << n << ")";
+		extra << fixed << setprecision(1) << file_mb << " MB file, map "
+			<< ResidentMegabytes() - base << " MB"
+			<< "  " << Verdict(ok && lemon::countNodes(graph) == n, "FAILED");
+		Report(label.str(), seconds, n, "nodes", extra.str());
+	}
+});
+
+// ==================================================== //
+
+int main(int argc, char* argv[]) {
+	gflags::SetUsageMessage(USAGE);
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+	// The sampler logs would drown the results
+	el::Loggers::getLogger(SPPM_LOGGER);
+	el::Configurations conf;
+	conf.setToDefault();
+	conf.setGlobally(el::ConfigurationType::Enabled, "false");
+	el::Loggers::reconfigureAllLoggers(conf);
+
+	for (const Benchmark& benchmark : Registry()) {
+		if (benchmark.name.find(FLAGS_filter) == string::npos) continue;
+		cout << benchmark.name << endl;
+		benchmark.run();
+	}
+
+	if (s_num_failed) cout << "FAILED: " << s_num_failed << " checks" << endl;
+	return s_num_failed ? 1 : 0;
+}
@@ -0,0 +1,513 @@
+/*
+   Copyright (C) 2014  Leonardo Vilela Teixeira
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   */
+
+// Synthetic maps with planted clusters, for testing at scale. The regions sit
+// on the cells of a side x side grid:
+//   grid    one region per cell, at its centre, joined to the 4 neighbours
+//   points  one random point per cell, triangulated: neighbours in the grid
+//           plus the shorter diagonal of every cell quad
+//   map     the points, kept only inside a random outline with a few lakes
+//           (so the map has an irregular coast, holes and islands)
+// The clusters are the Voronoi cells of random seeds, one per cell of a
+// coarse grid. Each cluster draws its parameters from the priors of the
+// models (mu, tau from the Normal-Gamma and theta from the Gamma) and each
+// region draws Y ~ N(mu, 1/tau), E ~ U(expected_min, expected_max) and
+// O ~ Poisson(E theta).
+//
+// Every value is drawn from a Philox stream keyed by the seed and the cell,
+// so any part of the map can be generated on its own: blocks of rows are
+// generated in parallel and written in order, and the memory does not grow
+// with the size of the map.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "philox.h"
+#include "sampling.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// ========================== //
+
+DEFINE_uint64(seed, 1, "random seed");
+DEFINE_uint64(clusters, 16, "number of planted clusters (rounded to a square)");
+DEFINE_string(format, "geojson", "output: 'geojson' (<prefix>.json), 'edges' "
+	"(<prefix>_edges.csv and <prefix>_nodes.csv) or 'both'");
+DEFINE_uint64(num_threads, 0, "number of threads (0 uses every core)");
+DEFINE_double(normal_a, 2, "shape of the Gamma prior of tau");
+DEFINE_double(normal_b, 1, "rate of the Gamma prior of tau");
+DEFINE_double(normal_m, 0, "mean of the prior of mu");
+DEFINE_double(normal_v, 0.05, "precision scale of the prior of mu (mu | tau ~ "
+	"N(m, 1/(v tau)))");
+DEFINE_double(poisson_a, 4, "shape of the Gamma prior of theta");
+DEFINE_double(poisson_b, 4, "rate of the Gamma prior of theta");
+DEFINE_double(expected_min, 5, "smallest expected count E");
+DEFINE_double(expected_max, 50, "largest expected count E");
+
+static const char USAGE[] =
+R"(
+Usage:
+	sppm_gen [options] <grid|points|map> <num_nodes> <prefix>
+
+	Writes a synthetic map of about num_nodes regions with planted clusters,
+	and the parameters of the clusters to <prefix>_clusters.csv. The regions
+	have the attributes Y (normal), O and E (Poisson) and their cluster.
+)";
+
+// Rows generated per task
+static const int kBlockRows = 16;
+
+// ========================== //
+
+enum Layout {
+	kLayoutGrid,
+	kLayoutPoints,
+	kLayoutMap
+};
+
+// Kinds of Philox streams (the chain of the key); the cell is the counter
+enum StreamKind {
+	kStreamPoint = 0,
+	kStreamAttribute = 1,
+	kStreamShape = 2,
+	kStreamCluster = 3
+};
+
+struct Cluster {
+	double x;
+	double y;
+	double mu;
+	double tau;
+	double theta;
+};
+
+// ==================================================== //
+
+class Generator {
+	public:
+		Generator(Layout layout, long long num_nodes, int num_clusters);
+
+		int Side() const { return m_side; }
+
+		void WriteClusters(const string& filename) const;
+
+		// Writes the map, the GeoJSON and/or the edge and node tables (any
+		// stream can be null). Returns the number of nodes and edges.
+		void Write(ostream* geojson, ostream* edges, ostream* nodes,
+			ThreadPool& pool, long long& num_nodes, long long& num_edges);
+
+	private:
+		Layout m_layout;
+		int m_side;
+		uint64_t m_seed;
+
+		// Outline of the map: radius harmonics and lakes (x, y, radius)
+		vector<double> m_amplitude;
+		vector<double> m_phase;
+		vector<double> m_lakes;
+
+		// Seeds on a coarse grid of m_cells x m_cells, m_cell_size apart
+		int m_cells;
+		double m_cell_size;
+		vector<Cluster> m_clusters;
+
+		// Id of the first node of each row (the nodes are numbered row by
+		// row, skipping the empty cells)
+		vector<long long> m_row_offset;
+
+		void Point(int r, int c, double& x, double& y) const;
+		bool Present(int r, int c) const;
+		bool Inside(double x, double y) const;
+		int Diagonal(int r, int c) const;
+		int NearestCluster(double x, double y) const;
+
+		void RowIds(int r, vector<long long>& ids) const;
+		void WriteRows(int first, int last, ostringstream* geojson,
+			ostringstream* edges, ostringstream* nodes, long long& num_edges) const;
+};
+
+// ========================== //
+
+Generator::Generator(Layout layout, long long num_nodes, int num_clusters)
+	: m_layout(layout), m_seed(FLAGS_seed) {
+
+	Util::Philox rng(m_seed, kStreamShape);
+	if (m_layout == kLayoutMap) {
+		for (int k = 2; k <= 7; ++k) {
+			m_amplitude.push_back(0.25 / k * Util::runif(rng));
+			m_phase.push_back(2 * M_PI * Util::runif(rng));
+		}
+		for (int k = 0; k < 3; ++k) {
+			m_lakes.push_back(0.3 + 0.4 * Util::runif(rng));
+			m_lakes.push_back(0.3 + 0.4 * Util::runif(rng));
+			m_lakes.push_back(0.02 + 0.04 * Util::runif(rng));
+		}
+	}
+
+	// Fraction of the square inside the outline, to size the grid
+	double fraction = 1.0;
+	if (m_layout == kLayoutMap) {
+		int inside = 0;
+		const int kProbes = 100000;
+		for (int i = 0; i < kProbes; ++i) {
+			inside += Inside(Util::runif(rng), Util::runif(rng));
+		}
+		fraction = max(inside, 1) / static_cast<double>(kProbes);
+	}
+	m_side = max(2, static_cast<int>(ceil(sqrt(num_nodes / fraction))));
+
+	m_cells = max(1, static_cast<int>(round(sqrt(static_cast<double>(num_clusters)))));
+	m_cell_size = static_cast<double>(m_side) / m_cells;
+	Util::Philox cluster_rng(m_seed, kStreamCluster);
+	for (int i = 0; i < m_cells; ++i) {
+		for (int j = 0; j < m_cells; ++j) {
+			Cluster cluster;
+			cluster.x = (j + Util::runif(cluster_rng)) * m_cell_size;
+			cluster.y = (i + Util::runif(cluster_rng)) * m_cell_size;
+			cluster.tau = Util::rgamma(FLAGS_normal_a, FLAGS_normal_b, cluster_rng);
+			cluster.mu = Util::rnormal(FLAGS_normal_m, FLAGS_normal_v * cluster.tau,
+				cluster_rng);
+			cluster.theta = Util::rgamma(FLAGS_poisson_a, FLAGS_poisson_b, cluster_rng);
+			m_clusters.push_back(cluster);
+		}
+	}
+}
+
+// ========================== //
+
+void Generator::Point(int r, int c, double& x, double& y) const {
+	if (m_layout == kLayoutGrid) {
+		x = c + 0.5;
+		y = r + 0.5;
+		return;
+	}
+	Util::Philox rng(m_seed, kStreamPoint, r, c);
+	x = c + Util::runif(rng);
+	y = r + Util::runif(rng);
+}
+
+// ========================== //
+
+// Inside the outline, in coordinates scaled to the unit square
+bool Generator::Inside(double x, double y) const {
+	double dx = x - 0.5;
+	double dy = y - 0.5;
+	double angle = atan2(dy, dx);
+	double radius = 1.0;
+	for (size_t k = 0; k < m_amplitude.size(); ++k) {
+		radius += m_amplitude[k] * sin((k + 2) * angle + m_phase[k]);
+	}
+	if (dx * dx + dy * dy > 0.16 * radius * radius) return false;
+	for (size_t k = 0; k < m_lakes.size(); k += 3) {
+		double lx = x - m_lakes[k];
+		double ly = y - m_lakes[k + 1];
+		if (lx * lx + ly * ly < m_lakes[k + 2] * m_lakes[k + 2]) return false;
+	}
+	return true;
+}
+
+// ========================== //
+
+bool Generator::Present(int r, int c) const {
+	if (r < 0 || c < 0 || r >= m_side || c >= m_side) return false;
+	if (m_layout != kLayoutMap) return true;
+	double x, y;
+	Point(r, c, x, y);
+	return Inside(x / m_side, y / m_side);
+}
+
+// ========================== //
+
+// The diagonal of the quad with top-left corner (r, c): 0 joins (r, c) to
+// (r + 1, c + 1), 1 joins (r, c + 1) to (r + 1, c), -1 is none. A quad with
+// a missing corner takes the diagonal that avoids it.
+int Generator::Diagonal(int r, int c) const {
+	if (m_layout == kLayoutGrid) return -1;
+	bool a = Present(r, c);
+	bool b = Present(r, c + 1);
+	bool d = Present(r + 1, c);
+	bool e = Present(r + 1, c + 1);
+	int corners = a + b + d + e;
+	if (corners < 3) return -1;
+	if (corners == 3) return (a && e) ? 0 : 1;
+
+	double ax, ay, bx, by, dx, dy, ex, ey;
+	Point(r, c, ax, ay);
+	Point(r, c + 1, bx, by);
+	Point(r + 1, c, dx, dy);
+	Point(r + 1, c + 1, ex, ey);
+	double main = (ex - ax) * (ex - ax) + (ey - ay) * (ey - ay);
+	double anti = (dx - bx) * (dx - bx) + (dy - by) * (dy - by);
+	return main <= anti ? 0 : 1;
+}
+
+// ========================== //
+
+// The seed of a point's cell is within sqrt(2) cells of it, and seeds two or
+// more cells away are farther than that, so the 5 x 5 cells around suffice
+int Generator::NearestCluster(double x, double y) const {
+	int ci = min(m_cells - 1, static_cast<int>(y / m_cell_size));
+	int cj = min(m_cells - 1, static_cast<int>(x / m_cell_size));
+	int best = 0;
+	double best_dist = numeric_limits<double>::max();
+	for (int i = max(0, ci - 2); i <= min(m_cells - 1, ci + 2); ++i) {
+		for (int j = max(0, cj - 2); j <= min(m_cells - 1, cj + 2); ++j) {
+			const Cluster& cluster = m_clusters[i * m_cells + j];
+			double dist = (cluster.x - x) * (cluster.x - x)
+				+ (cluster.y - y) * (cluster.y - y);
+			if (dist < best_dist) {
+				best_dist = dist;
+				best = i * m_cells + j;
+			}
+		}
+	}
+	return best;
+}
+
+// ========================== //
+
+// Ids of the nodes of a row, -1 for the empty cells
+void Generator::RowIds(int r, vector<long long>& ids) const {
+	ids.assign(m_side, -1);
+	if (r < 0 || r >= m_side) return;
+	long long id = m_row_offset[r];
+	for (int c = 0; c < m_side; ++c) {
+		if (Present(r, c)) ids[c] = id++;
+	}
+}
+
+// ========================== //
+
+void Generator::WriteClusters(const string& filename) const {
+	ofstream file(filename);
+	file << "cluster,x,y,mu,tau,theta" << endl;
+	file << setprecision(10);
+	for (size_t k = 0; k < m_clusters.size(); ++k) {
+		const Cluster& cluster = m_clusters[k];
+		file << k << "," << cluster.x << "," << cluster.y << "," << cluster.mu
+			<< "," << cluster.tau << "," << cluster.theta << endl;
+	}
+	if (!file) {
+		throw std::ios_base::failure("Failed to write " + filename);
+	}
+}
+
+// ========================== //
+
+// Rows [first, last): the nodes in id order, with their neighbours
+void Generator::WriteRows(int first, int last, ostringstream* geojson,
+	ostringstream* edges, ostringstream* nodes, long long& num_edges) const {
+
+	// Ids of the rows around, and the diagonals of the quads above and below
+	vector<long long> above, row, below;
+	RowIds(first - 1, above);
+	RowIds(first, row);
+	vector<int> diagonal_above(m_side), diagonal_below(m_side);
+	for (int c = 0; c + 1 < m_side; ++c) diagonal_below[c] = Diagonal(first - 1, c);
+
+	num_edges = 0;
+	vector<long long> neighbours;
+	for (int r = first; r < last; ++r) {
+		RowIds(r + 1, below);
+		diagonal_above.swap(diagonal_below);
+		for (int c = 0; c + 1 < m_side; ++c) diagonal_below[c] = Diagonal(r, c);
+
+		for (int c = 0; c < m_side; ++c) {
+			long long id = row[c];
+			if (id < 0) continue;
+
+			neighbours.clear();
+			if (above[c] >= 0) neighbours.push_back(above[c]);
+			if (c > 0 && diagonal_above[c - 1] == 0) neighbours.push_back(above[c - 1]);
+			if (c + 1 < m_side && diagonal_above[c] == 1) neighbours.push_back(above[c + 1]);
+			if (c > 0 && row[c - 1] >= 0) neighbours.push_back(row[c - 1]);
+			if (c + 1 < m_side && row[c + 1] >= 0) neighbours.push_back(row[c + 1]);
+			if (c > 0 && diagonal_below[c - 1] == 1) neighbours.push_back(below[c - 1]);
+			if (c + 1 < m_side && diagonal_below[c] == 0) neighbours.push_back(below[c + 1]);
+			if (below[c] >= 0) neighbours.push_back(below[c]);
+
+			double x, y;
+			Point(r, c, x, y);
+			int cluster_id = NearestCluster(x, y);
+			const Cluster& cluster = m_clusters[cluster_id];
+			Util::Philox rng(m_seed, kStreamAttribute, r, c);
+			double value = Util::rnormal(cluster.mu, cluster.tau, rng);
+			double expected = FLAGS_expected_min
+				+ (FLAGS_expected_max - FLAGS_expected_min) * Util::runif(rng);
+			poisson_distribution<int> poisson(expected * cluster.theta);
+			int count = poisson(rng);
+
+			if (geojson) {
+				*geojson << (id == 0 ? "" : ",\n")
+					<< "{\"type\": \"Feature\", \"id\": " << id
+					<< ", \"geometry\": {\"type\": \"Point\", \"coordinates\": ["
+					<< x << ", " << y << "]}, \"properties\": {\"Y\": " << value
+					<< ", \"O\": " << count << ", \"E\": " << expected
+					<< ", \"cluster\": " << cluster_id << "}, \"neighbours\": [";
+				for (size_t k = 0; k < neighbours.size(); ++k) {
+					*geojson << (k == 0 ? "" : ", ") << neighbours[k];
+				}
+				*geojson << "]}";
+			}
+			if (nodes) {
+				*nodes << id << "," << x << "," << y << "," << cluster_id << ","
+					<< value << "," << count << "," << expected << "\n";
+			}
+			for (long long v : neighbours) {
+				if (v < id) continue;
+				num_edges++;
+				if (edges) *edges << id << "," << v << "\n";
+			}
+		}
+		above.swap(row);
+		row.swap(below);
+	}
+}
+
+// ========================== //
+
+void Generator::Write(ostream* geojson, ostream* edges, ostream* nodes,
+	ThreadPool& pool, long long& num_nodes, long long& num_edges) {
+
+	// Count the nodes of each row, for their ids
+	vector<long long> count(m_side);
+	pool.ParallelFor(m_side, [&](int r) {
+		for (int c = 0; c < m_side; ++c) count[r] += Present(r, c);
+	});
+	m_row_offset.assign(m_side + 1, 0);
+	for (int r = 0; r < m_side; ++r) m_row_offset[r + 1] = m_row_offset[r] + count[r];
+	num_nodes = m_row_offset[m_side];
+	num_edges = 0;
+
+	if (geojson) {
+		*geojson << "{\"type\": \"FeatureCollection\", \"features\": [\n";
+	}
+	if (edges) *edges << "u,v\n";
+	if (nodes) *nodes << "id,x,y,cluster,Y,O,E\n";
+
+	// A few blocks per thread at a time, written in order
+	int num_blocks = (m_side + kBlockRows - 1) / kBlockRows;
+	int wave = 4 * pool.NumThreads();
+	for (int first = 0; first < num_blocks; first += wave) {
+		int size = min(wave, num_blocks - first);
+		vector<ostringstream> geojson_out(size), edges_out(size), nodes_out(size);
+		vector<long long> block_edges(size);
+		pool.ParallelFor(size, [&](int i) {
+			int r = (first + i) * kBlockRows;
+			for (ostringstream* out : {&geojson_out[i], &edges_out[i], &nodes_out[i]}) {
+				*out << setprecision(8);
+			}
+			WriteRows(r, min(r + kBlockRows, m_side),
+				geojson ? &geojson_out[i] : nullptr, edges ? &edges_out[i] : nullptr,
+				nodes ? &nodes_out[i] : nullptr, block_edges[i]);
+		});
+		for (int i = 0; i < size; ++i) {
+			if (geojson) *geojson << geojson_out[i].str();
+			if (edges) *edges << edges_out[i].str();
+			if (nodes) *nodes << nodes_out[i].str();
+			num_edges += block_edges[i];
+		}
+	}
+
+	if (geojson) *geojson << "\n]}\n";
+}
+
+// ==================================================== //
+
+int main(int argc, char* argv[]) {
+	gflags::SetUsageMessage(USAGE);
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+	if (argc != 4) {
+		cerr << "Invalid usage." << endl;
+		cerr << USAGE << endl;
+		return 1;
+	}
+	string layout_name = argv[1];
+	Layout layout;
+	if (layout_name == "grid") layout = kLayoutGrid;
+	else if (layout_name == "points") layout = kLayoutPoints;
+	else if (layout_name == "map") layout = kLayoutMap;
+	else {
+		cerr << "Invalid layout: " << layout_name << endl;
+		return 1;
+	}
+	long long num_nodes = atoll(argv[2]);
+	if (num_nodes < 4) {
+		cerr << "Invalid number of nodes: " << argv[2] << endl;
+		return 1;
+	}
+	if (FLAGS_format != "geojson" && FLAGS_format != "edges" && FLAGS_format != "both") {
+		cerr << "Invalid format: " << FLAGS_format << endl;
+		return 1;
+	}
+	if (FLAGS_clusters < 1 || FLAGS_expected_min <= 0
+		|| FLAGS_expected_max < FLAGS_expected_min) {
+		cerr << "Invalid cluster or expected count parameters" << endl;
+		return 1;
+	}
+	string prefix = argv[3];
+	int num_threads = FLAGS_num_threads;
+	if (num_threads == 0) {
+		num_threads = max(1u, thread::hardware_concurrency());
+	}
+
+	try {
+		Generator generator(layout, num_nodes, FLAGS_clusters);
+		generator.WriteClusters(prefix + "_clusters.csv");
+
+		ofstream geojson, edges, nodes;
+		if (FLAGS_format != "edges") geojson.open(prefix + ".json");
+		if (FLAGS_format != "geojson") {
+			edges.open(prefix + "_edges.csv");
+			nodes.open(prefix + "_nodes.csv");
+		}
+
+		ThreadPool pool(num_threads);
+		long long num_edges = 0;
+		generator.Write(geojson.is_open() ? &geojson : nullptr,
+			edges.is_open() ? &edges : nullptr, nodes.is_open() ? &nodes : nullptr,
+			pool, num_nodes, num_edges);
+		if (!geojson.good() && geojson.is_open()) {
+			throw std::ios_base::failure("Failed to write " + prefix + ".json");
+		}
+		if ((!edges.good() && edges.is_open()) || (!nodes.good() && nodes.is_open())) {
+			throw std::ios_base::failure("Failed to write the tables of " + prefix);
+		}
+
+		cout << num_nodes << " nodes, " << num_edges << " edges ("
+			<< generator.Side() << " x " << generator.Side() << " grid)" << endl;
+	} catch (const std::exception& e) {
+		cerr << "Failed: " << e.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,581 @@
+#ifndef SPPM_MODEL_H_
+#define SPPM_MODEL_H_
+
+#include "sppm.h"
+#include "masked_moments.h"
+#include "profiler.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "log.h"
+#include <lemon/kruskal.h>
+
+// ========================== //
+
+// The sampler for a given likelihood. All the per edge work (the searches
+// for the two groups around an edge and the predictive ratio) is done here,
+// against a compile-time likelihood policy, so the whole sweep inlines.
+//
+// A likelihood policy is a class with:
+//
+//   struct Stats                 Sufficient statistics of a group. Default
+//                                constructed empty, with a member
+//                                Merge(const Stats&) to join two groups.
+//   void Add(Stats&, int) const  Add a node (by graph id) to the statistics.
+//   static const int kNumColumns Number of attribute columns the statistics
+//                                are built from.
+//   const double* Column(int k) const
+//                                The k-th column, indexed by node id.
+//   void AddMoments(Stats&, const Util::Moments* moments) const
+//                                Add a set of nodes, given the moments of
+//                                each column over the set.
+//   double LogMarginal(const Stats&) const
+//                                Log marginal likelihood (theta integrated
+//                                out) of a group with those statistics.
+//   double Dissimilarity(int u, int v) const
+//                                Attribute distance between two nodes (by
+//                                graph id), for the initial tree.
+//
+//   static const int kNumParams  Number of per group parameters (theta).
+//   static const char* ParamName(int k)
+//                                Name of the k-th parameter ('mu' gives the
+//                                output file 'mu.csv').
+//   template<class URNG> void SamplePrior(std::vector<double>* theta,
+//       URNG& g) const           Fill theta[k][i] from the prior, for all i.
+//   template<class URNG> void SamplePosterior(
+//       const std::vector<Stats>& stats, std::vector<double>* theta,
+//       URNG& g)                 Fill theta[k][i] from the posterior given
+//                                stats[i], for all i. Runs every iteration,
+//                                so scratch buffers should be members.
+//
+// A new conjugate family is then a single header with its policy (see
+// sppm_normal.h and sppm_poisson.h).
+template <class Likelihood>
+class SPPM_Model: public SPPM {
+	public:
+		SPPM_Model(lemon::SmartGraph& graph,
+			lemon::SmartGraph::NodeMap<long long>& node_id,
+			lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute,
+			const std::string& logger_id);
+
+		double LogLikelihood() const;
+
+		int NumParams() const { return kNumParams; }
+		const char* ParamName(int k) const { return Likelihood::ParamName(k); }
+		const std::vector<std::vector<double>>& Theta() const { return m_theta; }
+
+	protected:
+		typedef typename Likelihood::Stats Stats;
+		static const int kNumParams = Likelihood::kNumParams;
+		static const int kNumColumns = Likelihood::kNumColumns;
+
+		// Groups covering at least 1/kDenseRatio of their component's id
+		// range are summed with a streaming pass over the masks instead of
+		// node by node
+		static const int kDenseRatio = 8;
+
+		Likelihood m_likelihood;
+
+		// Current state: theta of each group (m_theta[k] is indexed by the
+		// group label)
+		std::vector<std::vector<double>> m_theta;
+
+	private:
+		// Split-merge workspace: the merged group as a rooted tree (nodes
+		// in search order, with the tree edge to and the position of their
+		// parents), the column moments of every subtree and the weight of
+		// cutting above each node. m_in_group marks the nodes by id.
+		std::vector<lemon::SmartGraph::Node> m_group_nodes;
+		std::vector<lemon::SmartGraph::Edge> m_group_edges;
+		std::vector<int> m_group_parent;
+		std::vector<Util::Moments> m_subtree;
+		std::vector<double> m_cut_weight;
+		std::vector<char> m_in_group;
+
+		// Statistics of every group, by label (reused by SampleTheta and
+		// LogLikelihood, so they do not allocate once grown)
+		mutable std::vector<Stats> m_group_stats;
+
+		void SweepComponent(FilteredGraph& filtered_graph, int component,
+			Batch& batch);
+		double ComputeLogRatio(FilteredGraph& filtered_graph,
+			lemon::SmartGraph::Edge& e, int component, int num_groups,
+			Batch& batch);
+		size_t FindGroup(FilteredGraph& filtered_graph,
+			lemon::SmartGraph::Node s, std::vector<uint64_t>& mask,
+			Batch& batch);
+		void CollectStats(int component, size_t size_u, Batch& batch,
+			Stats& stats_u, Stats& stats_v);
+
+		bool ProposeResplit(lemon::SmartGraph::Edge& cut);
+		void FindMergedGroup(lemon::SmartGraph::Node root, long long a,
+			long long b);
+		void SubtreeMoments();
+		void CutStats(size_t i, Stats& below, Stats& rest) const;
+
+		void GenerateDissimilarityTree();
+		void GreedyCuts(int num_groups);
+		double BestCut(lemon::SmartGraph::Node root, long long label,
+			lemon::SmartGraph::Edge& cut);
+
+		void GenerateInitialTheta();
+		void SampleTheta();
+		void SwapTheta(SPPM& other);
+};
+
+// ==================================================== //
+
+template <class Likelihood>
+SPPM_Model<Likelihood>::SPPM_Model(lemon::SmartGraph& graph,
+	lemon::SmartGraph::NodeMap<long long>& node_id,
+	lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute,
+	const std::string& logger_id)
+		: SPPM(graph, node_id, node_attribute, logger_id), m_theta(kNumParams),
+		  m_in_group(graph.maxNodeId() + 1, 0) {
+
+	SAMPLER_LOG(INFO) << " -- Statistics kernel: " << Util::MaskedMomentsKernelName();
+}
+
+// ========================== //
+
+template <class Likelihood>
+double SPPM_Model<Likelihood>::LogLikelihood() const {
+	// Groups are labelled 1..m_num_groups
+	std::vector<Stats>& stats = m_group_stats;
+	stats.assign(m_num_groups + 1, Stats());
+	for (lemon::SmartGraph::NodeIt u(m_graph); u != lemon::INVALID; ++u) {
+		m_likelihood.Add(stats[m_pi[u]], m_graph.id(u));
+	}
+
+	double result = 0.0;
+	for (int grp = 1; grp <= m_num_groups; ++grp) {
+		result += m_likelihood.LogMarginal(stats[grp]);
+	}
+	return result;
+}
+
+// ========================== //
+
+template <class Likelihood>
+void SPPM_Model<Likelihood>::SweepComponent(FilteredGraph& filtered_graph,
+	int component, Batch& batch) {
+
+	// Each component draws from its own stream, so the result does not
+	// depend on how the components are spread among the workers
+	Util::Philox rng = Stream(kStreamComponent + component);
+
+	// Only used (and only exact) when the graph has a single component
+	int num_groups = m_num_groups;
+
+	// For each tree edge, remove it or leave it.
+	std::uniform_real_distribution<double> coin_toss(0.0, 1.0);
+	for (lemon::SmartGraph::Edge& e : m_component_edges[component]) {
+		if (!m_tree[e]) continue;
+
+		// The prior ratio is taken at the number of groups with e cut
+		bool was_there = filtered_graph.status(e);
+		double log_ratio = ComputeLogRatio(filtered_graph, e, component,
+			was_there ? num_groups + 1 : num_groups, batch);
+		// The MAP search takes the more probable state
+		double threshold = 0.0;
+		if (!m_greedy) {
+			double coin = coin_toss(rng);
+			threshold = std::log((1.0 - coin) / coin);
+		}
+		if (log_ratio >= threshold) {
+			// Keep Edge
+			filtered_graph.status(e, true);
+			if (!was_there) num_groups--;
+		}
+		else {
+			// Remove Edge
+			filtered_graph.status(e, false);
+			if (was_there) num_groups++;
+		}
+	}
+}
+
+// ========================== //
+
+template <class Likelihood>
+double SPPM_Model<Likelihood>::ComputeLogRatio(FilteredGraph& filtered_graph,
+	lemon::SmartGraph::Edge& e, int component, int num_groups, Batch& batch) {
+	Util::ScopedTimer timer(Util::kPhaseComputeLogRatio);
+
+	// We must keep the filtered graph the same. But we remove the edge from it
+	// in order to find the two groups formed by its removal. So we keep the
+	// status to restore it afterwards
+	bool status = filtered_graph.status(e);
+	filtered_graph.disable(e);
+
+	// The two groups on each side of the edge (u's nodes first in the queue)
+	batch.queue.clear();
+	size_t size_u = FindGroup(filtered_graph, m_graph.u(e), batch.mask_u, batch);
+	FindGroup(filtered_graph, m_graph.v(e), batch.mask_v, batch);
+
+	// Restore the filtered graph (we disabled the edge, so if it wasn't
+	// initially disabled we must restore it)
+	filtered_graph.status(e, status);
+
+	Stats stats_u, stats_v;
+	CollectStats(component, size_u, batch, stats_u, stats_v);
+	Stats stats_uv = stats_u;
+	stats_uv.Merge(stats_v);
+
+	// Every bit set belongs to a node in the queue
+	for (lemon::SmartGraph::Node w : batch.queue) {
+		int word = m_graph.id(w) / 64;
+		batch.mask_u[word] = 0;
+		batch.mask_v[word] = 0;
+	}
+
+	// Compute ratio (only the likelihood is tempered)
+	double ratio = m_likelihood.LogMarginal(stats_uv);
+	ratio -= m_likelihood.LogMarginal(stats_u);
+	ratio -= m_likelihood.LogMarginal(stats_v);
+	ratio = m_beta * ratio + LogPriorRatio(num_groups);
+
+	return ratio;
+}
+
+// ========================== //
+
+template <class Likelihood>
+size_t SPPM_Model<Likelihood>::FindGroup(FilteredGraph& filtered_graph,
+	lemon::SmartGraph::Node s, std::vector<uint64_t>& mask, Batch& batch) {
+	Util::ScopedTimer timer(Util::kPhaseFindGroup);
+
+	// Breadth-first search from s, appending every node reached to the queue
+	// and setting its bit in the mask
+	std::vector<lemon::SmartGraph::Node>& queue = batch.queue;
+	size_t first = queue.size();
+	queue.push_back(s);
+	int id = m_graph.id(s);
+	mask[id / 64] |= uint64_t(1) << (id % 64);
+	for (size_t head = first; head < queue.size(); ++head) {
+		lemon::SmartGraph::Node u = queue[head];
+		for (lemon::SmartGraph::IncEdgeIt e(m_graph, u); e != lemon::INVALID; ++e) {
+			if (!filtered_graph.status(e)) continue;
+			lemon::SmartGraph::Node w = m_graph.oppositeNode(u, e);
+			int id = m_graph.id(w);
+			uint64_t bit = uint64_t(1) << (id % 64);
+			if (!(mask[id / 64] & bit)) {
+				mask[id / 64] |= bit;
+				queue.push_back(w);
+			}
+		}
+	}
+
+	return queue.size() - first;
+}
+
+// ========================== //
+
+template <class Likelihood>
+void SPPM_Model<Likelihood>::CollectStats(int component, size_t size_u,
+	Batch& batch, Stats& stats_u, Stats& stats_v) {
+
+	const std::vector<lemon::SmartGraph::Node>& queue = batch.queue;
+	const std::pair<int, int>& span = m_component_span[component];
+	size_t begin = span.first / 64 * 64;
+	size_t count = span.second - begin;
+
+	// Small groups: gather node by node
+	if (queue.size() * kDenseRatio < count) {
+		for (size_t i = 0; i < size_u; ++i) {
+			m_likelihood.Add(stats_u, m_graph.id(queue[i]));
+		}
+		for (size_t i = size_u; i < queue.size(); ++i) {
+			m_likelihood.Add(stats_v, m_graph.id(queue[i]));
+		}
+		return;
+	}
+
+	// Large groups: one pass over the columns for both sides
+	Util::Moments moments_u[kNumColumns];
+	Util::Moments moments_v[kNumColumns];
+	for (int k = 0; k < kNumColumns; ++k) {
+		Util::MaskedMoments(&batch.mask_u[begin / 64], &batch.mask_v[begin / 64],
+			m_likelihood.Column(k) + begin, count, &moments_u[k], &moments_v[k]);
+	}
+	m_likelihood.AddMoments(stats_u, moments_u);
+	m_likelihood.AddMoments(stats_v, moments_v);
+}
+
+// ========================== //
+
+template <class Likelihood>
+bool SPPM_Model<Likelihood>::ProposeResplit(lemon::SmartGraph::Edge& cut) {
+	long long a = m_pi[m_graph.u(cut)];
+	long long b = m_pi[m_graph.v(cut)];
+	FindMergedGroup(m_graph.u(cut), a, b);
+	SubtreeMoments();
+	size_t size = m_group_nodes.size();
+
+	// Both resulting partitions have the same number of groups, so their
+	// posterior ratio is the predictive ratio alone
+	m_cut_weight.resize(size);
+	double max_weight = -std::numeric_limits<double>::infinity();
+	for (size_t i = 1; i < size; ++i) {
+		Stats stats_below, stats_rest;
+		CutStats(i, stats_below, stats_rest);
+		m_cut_weight[i] = m_beta * (m_likelihood.LogMarginal(stats_below)
+			+ m_likelihood.LogMarginal(stats_rest));
+		max_weight = std::max(max_weight, m_cut_weight[i]);
+	}
+
+	// Draw the new cut from its conditional distribution (a Metropolis
+	// proposal that is always accepted)
+	double sum = 0.0;
+	for (size_t i = 1; i < size; ++i) {
+		m_cut_weight[i] = std::exp(m_cut_weight[i] - max_weight);
+		sum += m_cut_weight[i];
+	}
+	std::uniform_real_distribution<double> unif(0.0, sum);
+	double target = unif(m_rng);
+	size_t chosen = size - 1;
+	for (size_t i = 1; i < size; ++i) {
+		target -= m_cut_weight[i];
+		if (target < 0) {
+			chosen = i;
+			break;
+		}
+	}
+
+	bool moved = m_group_edges[chosen] != cut;
+	if (moved) {
+		// The subtree of the chosen node (marked 2) gets b, the rest a
+		for (size_t i = 0; i < size; ++i) {
+			lemon::SmartGraph::Node w = m_group_nodes[i];
+			bool below = (i == chosen) || (i > chosen &&
+				m_in_group[m_graph.id(m_group_nodes[m_group_parent[i]])] == 2);
+			if (below) m_in_group[m_graph.id(w)] = 2;
+			m_pi[w] = below ? b : a;
+		}
+		cut = m_group_edges[chosen];
+	}
+
+	for (lemon::SmartGraph::Node w : m_group_nodes) m_in_group[m_graph.id(w)] = 0;
+	return moved;
+}
+
+// ========================== //
+
+template <class Likelihood>
+void SPPM_Model<Likelihood>::FindMergedGroup(lemon::SmartGraph::Node root,
+	long long a, long long b) {
+
+	// Breadth-first search along the tree, inside groups a and b. Node i is
+	// reached from node m_group_parent[i] through edge m_group_edges[i].
+	m_group_nodes.assign(1, root);
+	m_group_edges.assign(1, lemon::INVALID);
+	m_group_parent.assign(1, -1);
+	m_in_group[m_graph.id(root)] = 1;
+	for (size_t head = 0; head < m_group_nodes.size(); ++head) {
+		lemon::SmartGraph::Node u = m_group_nodes[head];
+		for (lemon::SmartGraph::IncEdgeIt e(m_graph, u); e != lemon::INVALID; ++e) {
+			if (!m_tree[e]) continue;
+			lemon::SmartGraph::Node w = m_graph.oppositeNode(u, e);
+			char& in_group = m_in_group[m_graph.id(w)];
+			if (in_group || (m_pi[w] != a && m_pi[w] != b)) continue;
+			in_group = 1;
+			m_group_nodes.push_back(w);
+			m_group_edges.push_back(e);
+			m_group_parent.push_back(head);
+		}
+	}
+}
+
+// ========================== //
+
+template <class Likelihood>
+void SPPM_Model<Likelihood>::SubtreeMoments() {
+	// Column moments of every subtree of the group found by FindMergedGroup
+	// (children come after their parents)
+	size_t size = m_group_nodes.size();
+	m_subtree.assign(size * kNumColumns, Util::Moments());
+	for (size_t i = 0; i < size; ++i) {
+		int id = m_graph.id(m_group_nodes[i]);
+		for (int k = 0; k < kNumColumns; ++k) {
+			Util::Moments& moments = m_subtree[i * kNumColumns + k];
+			double y = m_likelihood.Column(k)[id];
+			moments.count = 1.0;
+			moments.sum = y;
+			moments.sum_sq = y * y;
+		}
+	}
+	for (size_t i = size - 1; i > 0; --i) {
+		for (int k = 0; k < kNumColumns; ++k) {
+			m_subtree[m_group_parent[i] * kNumColumns + k].Merge(
+				m_subtree[i * kNumColumns + k]);
+		}
+	}
+}
+
+// ========================== //
+
+template <class Likelihood>
+void SPPM_Model<Likelihood>::CutStats(size_t i, Stats& below, Stats& rest) const {
+	// Cutting the edge above node i splits the group in the subtree of i
+	// and the rest
+	const Util::Moments* total = &m_subtree[0];
+	const Util::Moments* subtree = &m_subtree[i * kNumColumns];
+	Util::Moments others[kNumColumns];
+	for (int k = 0; k < kNumColumns; ++k) {
+		others[k].count = total[k].count - subtree[k].count;
+		others[k].sum = total[k].sum - subtree[k].sum;
+		others[k].sum_sq = total[k].sum_sq - subtree[k].sum_sq;
+	}
+	m_likelihood.AddMoments(below, subtree);
+	m_likelihood.AddMoments(rest, others);
+}
+
+// ========================== //
+
+template <class Likelihood>
+void SPPM_Model<Likelihood>::GenerateDissimilarityTree() {
+	SAMPLER_LOG(INFO) << " -- Generating: tree (minimum attribute dissimilarity)";
+	lemon::SmartGraph::EdgeMap<double> cost_map(m_graph);
+	for (lemon::SmartGraph::EdgeIt e(m_graph); e != lemon::INVALID; ++e) {
+		cost_map[e] = m_likelihood.Dissimilarity(m_graph.id(m_graph.u(e)),
+			m_graph.id(m_graph.v(e)));
+	}
+	lemon::kruskal(m_graph, cost_map, m_tree);
+}
+
+// ========================== //
+
+// SKATER-style initial partition: starting from one group per component,
+// repeatedly cut the tree edge with the largest gain in log marginal
+// likelihood, over all groups, until there are num_groups of them. Each group
+// keeps its best cut in a heap; a cut only rescores the two groups it makes,
+// so the whole search costs O(n) per level of splitting.
+template <class Likelihood>
+void SPPM_Model<Likelihood>::GreedyCuts(int num_groups) {
+	typedef std::pair<double, int> Candidate;
+	std::priority_queue<Candidate> heap;
+	std::vector<lemon::SmartGraph::Edge> best_cut;
+
+	auto push = [&](lemon::SmartGraph::Node root) {
+		lemon::SmartGraph::Edge cut;
+		double gain = BestCut(root, m_pi[root], cut);
+		if (cut == lemon::INVALID) return;
+		heap.push(Candidate(gain, best_cut.size()));
+		best_cut.push_back(cut);
+	};
+	for (int comp = 0; comp < m_num_components; ++comp) {
+		push(m_component_nodes[comp][0]);
+	}
+
+	while (m_num_groups < num_groups && !heap.empty()) {
+		lemon::SmartGraph::Edge cut = best_cut[heap.top().second];
+		heap.pop();
+
+		// The side of v gets a new label (the edge stays in the tree)
+		lemon::SmartGraph::Node u = m_graph.u(cut);
+		lemon::SmartGraph::Node v = m_graph.v(cut);
+		long long label = m_pi[u];
+		m_tree[cut] = false;
+		FindMergedGroup(v, label, label);
+		m_tree[cut] = true;
+		++m_num_groups;
+		for (lemon::SmartGraph::Node w : m_group_nodes) {
+			m_pi[w] = m_num_groups;
+			m_in_group[m_graph.id(w)] = 0;
+		}
+
+		push(u);
+		push(v);
+	}
+	if (m_num_groups < num_groups) {
+		SAMPLER_LOG(INFO) << " -- Only " << m_num_groups << " groups can be made";
+	}
+}
+
+// ========================== //
+
+// The cut of the group of root (along the tree) that most increases the log
+// marginal likelihood, and that increase. The cut is INVALID for a single node.
+template <class Likelihood>
+double SPPM_Model<Likelihood>::BestCut(lemon::SmartGraph::Node root,
+	long long label, lemon::SmartGraph::Edge& cut) {
+
+	FindMergedGroup(root, label, label);
+	SubtreeMoments();
+
+	Stats whole;
+	m_likelihood.AddMoments(whole, &m_subtree[0]);
+	double base = m_likelihood.LogMarginal(whole);
+
+	cut = lemon::INVALID;
+	double best = -std::numeric_limits<double>::infinity();
+	for (size_t i = 1; i < m_group_nodes.size(); ++i) {
+		Stats stats_below, stats_rest;
+		CutStats(i, stats_below, stats_rest);
+		double gain = m_likelihood.LogMarginal(stats_below)
+			+ m_likelihood.LogMarginal(stats_rest) - base;
+		if (gain > best) {
+			best = gain;
+			cut = m_group_edges[i];
+		}
+	}
+
+	for (lemon::SmartGraph::Node w : m_group_nodes) m_in_group[m_graph.id(w)] = 0;
+	return best;
+}
+
+// ========================== //
+
+template <class Likelihood>
+void SPPM_Model<Likelihood>::GenerateInitialTheta() {
+	SAMPLER_LOG(INFO) << " -- Generating: theta";
+	Util::Philox rng = Stream(kStreamTheta);
+
+	// Groups are labelled 1..m_num_groups
+	for (int k = 0; k < kNumParams; ++k) {
+		m_theta[k].assign(m_num_groups + 1, 0.0);
+	}
+	m_likelihood.SamplePrior(m_theta.data(), rng);
+}
+
+// ========================== //
+
+template <class Likelihood>
+void SPPM_Model<Likelihood>::SampleTheta() {
+	Util::ScopedTimer timer(Util::kPhaseSampleTheta);
+	SPPM_TRACE_EVENT(Util::kTraceTheta, m_num_groups);
+	Util::Philox rng = Stream(kStreamTheta);
+
+	// Groups are labelled 1..m_num_groups (see UpdatePi)
+	std::vector<Stats>& stats = m_group_stats;
+	stats.assign(m_num_groups + 1, Stats());
+	for (lemon::SmartGraph::NodeIt u(m_graph); u != lemon::INVALID; ++u) {
+		m_likelihood.Add(stats[m_pi[u]], m_graph.id(u));
+	}
+
+	// Sample the values for all groups at once
+	for (int k = 0; k < kNumParams; ++k) {
+		m_theta[k].resize(m_num_groups + 1);
+	}
+	m_likelihood.SamplePosterior(stats, m_theta.data(), rng);
+}
+
+// ========================== //
+
+template <class Likelihood>
+void SPPM_Model<Likelihood>::SwapTheta(SPPM& other) {
+	// Theta is integrated out of the partition updates, so tempered chains
+	// sample it untempered; it only travels with the state it belongs to
+	SPPM_Model<Likelihood>& model = dynamic_cast<SPPM_Model<Likelihood>&>(other);
+	for (int k = 0; k < kNumParams; ++k) m_theta[k].swap(model.m_theta[k]);
+}
+
+// ==================================================== //
+
+#endif // SPPM_MODEL_H_
@@ -1,48 +1,219 @@
 #ifndef SPPM_NORMAL_H_
 #define SPPM_NORMAL_H_
 
-#include "sppm.h"
+#include "sppm_model.h"
 
-#include <fstream>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "log.h"
+
+// ========================== //
+
+// Normal likelihood with a conjugate Normal-Gamma prior:
+//   y_i | mu, tau ~ N(mu, 1/tau),  mu | tau ~ N(m, 1/(v tau)),  tau ~ G(a, b)
+class NormalLikelihood {
+	public:
+		struct Stats {
+			int n;
+			double sum_y;
+			double sum_sq;
+
+			Stats() : n(0), sum_y(0.0), sum_sq(0.0) { }
+			void Merge(const Stats& other) {
+				n += other.n;
+				sum_y += other.sum_y;
+				sum_sq += other.sum_sq;
+			}
+		};
+
+		static const int kNumParams = 2;
+		static const char* ParamName(int k) { return k == 0 ? "mu" : "tau"; }
+
+		static const int kNumColumns = 1;
+		const double* Column(int) const { return m_y.data(); }
+
+		NormalLikelihood()
+			: m_alpha(1), m_beta(1), m_m(0), m_v(1), m_base_const(0), m_vm(0) { }
+
+		void SetAttribute(const lemon::SmartGraph& graph,
+			lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute,
+			std::string name);
+		void SetColumn(std::vector<double> y) { m_y.swap(y); }
+		void SetParameters(double alpha, double beta, double m, double v,
+			int max_size);
+
+		void Add(Stats& stats, int node) const {
+			double y = m_y[node];
+			stats.n++;
+			stats.sum_y += y;
+			stats.sum_sq += y * y;
+		}
+
+		void AddMoments(Stats& stats, const Util::Moments* moments) const {
+			stats.n += static_cast<int>(moments[0].count);
+			stats.sum_y += moments[0].sum;
+			stats.sum_sq += moments[0].sum_sq;
+		}
+
+		double LogMarginal(const Stats& stats) const {
+			int n = stats.n;
+			double shift = stats.sum_y + m_vm;
+			double base = m_base_const + 0.5*stats.sum_sq;
+			base -= 0.5 * shift * shift * m_inv_size[n];
+			return m_log_norm[n] - (m_alpha + n/2.0) * log(base);
+		}
+
+		double Dissimilarity(int u, int v) const {
+			return std::fabs(m_y[u] - m_y[v]);
+		}
+
+		template<class URNG>
+		void SamplePrior(std::vector<double>* theta, URNG& g) const;
+
+		template<class URNG>
+		void SamplePosterior(const std::vector<Stats>& stats,
+			std::vector<double>* theta, URNG& g);
+
+	private:
+		// Parameters
+		double m_alpha;
+		double m_beta;
+		double m_m;
+		double m_v;
+
+		// Attribute, indexed by node id
+		std::vector<double> m_y;
+
+		// Predictive cache: all the terms of the log predictive but the last
+		// one depend only on the hyperparameters and on the group size n, so
+		// they are tabulated for every possible size
+		std::vector<double> m_log_norm;
+		std::vector<double> m_inv_size;
+		double m_base_const;
+		double m_vm;
+
+		// Posterior parameters of every group (SamplePosterior scratch)
+		std::vector<double> m_post_a;
+		std::vector<double> m_post_b;
+		std::vector<double> m_post_m;
+		std::vector<double> m_post_prec;
+};
 
 // ========================== //
 
-class SPPM_Normal: public SPPM {
+class SPPM_Normal: public SPPM_Model<NormalLikelihood> {
 	public:
 		SPPM_Normal(lemon::SmartGraph& graph,
 			lemon::SmartGraph::NodeMap<long long>& node_id,
-			lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute);
+			lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute,
+			const std::string& logger_id = SPPM_LOGGER)
+				: SPPM_Model<NormalLikelihood>(graph, node_id, node_attribute,
+					logger_id) {
+			SAMPLER_LOG(INFO) << "== Initializing SPPM Normal";
+		}
 
-		void SetAttribute(std::string name);
-		void SetNormalGammaParameters(double alpha, double beta, double m, double v);
-	private:
+		void SetAttribute(std::string name) {
+			m_likelihood.SetAttribute(m_graph, m_node_attr, name);
+		}
 
-		// Parameters
-		double m_NG_alpha;
-		double m_NG_beta;
-		double m_NG_m;
-		double m_NG_v;
-		std::string m_attr;
-
-		// Current state
-		lemon::SmartGraph::NodeMap<double> m_mu;
-		lemon::SmartGraph::NodeMap<double> m_tau;
-
-		// Output files
-		std::ofstream m_mu_file;
-		std::ofstream m_tau_file;
-
-		void PrepareOutputTheta();
-		void FinishOutputTheta();
-		void GenerateInitialTheta();
-		void HoldTheta();
-		void SampleTheta();
-
-		double ComputeLogPredictive(int n, double sum_y, double sum_sq);
-		double ComputeLogRatioPredictive(lemon::SmartGraph::NodeMap<bool>& set_u,
-			lemon::SmartGraph::NodeMap<bool>& set_v);
+		// The attribute of each node, by node id
+		void SetAttributeColumn(std::vector<double> y) {
+			m_likelihood.SetColumn(y);
+		}
+
+		void SetNormalGammaParameters(double alpha, double beta, double m, double v) {
+			SAMPLER_LOG(INFO) << "== Setting parameters: mu, tau ~ NG(m=" << m << ", v=" << v << ", a=" << alpha << ", b=" << beta << ")";
+			m_likelihood.SetParameters(alpha, beta, m, v, lemon::countNodes(m_graph));
+		}
 };
 
+// ==================================================== //
+
+inline void NormalLikelihood::SetAttribute(const lemon::SmartGraph& graph,
+	lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute,
+	std::string name) {
+
+	m_y.assign(graph.maxNodeId() + 1, 0.0);
+	for (lemon::SmartGraph::NodeIt u(graph); u != lemon::INVALID; ++u) {
+		m_y[graph.id(u)] = node_attribute[u][name];
+	}
+}
+
 // ========================== //
 
+inline void NormalLikelihood::SetParameters(double alpha, double beta,
+	double m, double v, int max_size) {
+
+	m_alpha = alpha;
+	m_beta = beta;
+	m_m = m;
+	m_v = v;
+
+	double a = alpha;
+	double b = beta;
+	double constant = -lgamma(a) + 0.5 * log(v) + a * log(b);
+	m_log_norm.resize(max_size + 1);
+	m_inv_size.resize(max_size + 1);
+	for (int n = 0; n <= max_size; ++n) {
+		m_log_norm[n] = constant + lgamma(a + n / 2.0);
+		m_log_norm[n] += -n/2.0 * log(2 * M_PI) - 0.5 * log(n + v);
+		m_inv_size[n] = 1.0 / (n + v);
+	}
+
+	m_base_const = b + 0.5*v*m*m;
+	m_vm = v*m;
+}
+
+// ========================== //
+
+template<class URNG>
+void NormalLikelihood::SamplePrior(std::vector<double>* theta, URNG& g) const {
+	std::vector<double>& mu = theta[0];
+	std::vector<double>& tau = theta[1];
+	for (size_t i = 0; i < mu.size(); ++i) {
+		tau[i] = Util::rgamma(m_alpha, m_beta, g);
+		mu[i] = Util::rnormal(m_m, m_v * tau[i], g);
+	}
+}
+
+// ========================== //
+
+template<class URNG>
+void NormalLikelihood::SamplePosterior(const std::vector<Stats>& stats,
+	std::vector<double>* theta, URNG& g) {
+
+	// Posterior parameters for every group
+	int num_groups = stats.size();
+	std::vector<double>& a = m_post_a;
+	std::vector<double>& b = m_post_b;
+	std::vector<double>& m = m_post_m;
+	std::vector<double>& prec = m_post_prec;
+	a.resize(num_groups);
+	b.resize(num_groups);
+	m.resize(num_groups);
+	prec.resize(num_groups);
+	for (int grp = 0; grp < num_groups; ++grp) {
+		double n = stats[grp].n;
+		double sum_y = stats[grp].sum_y;
+		double mean = (n > 0) ? sum_y / n : 0.0;
+		a[grp] = m_alpha + 0.5 * n;
+		b[grp] = m_beta + 0.5*(stats[grp].sum_sq - sum_y * mean);
+		b[grp] += 0.5*(n*m_v)/(n+m_v)*pow(mean - m_m, 2);
+		m[grp] = (m_v*m_m + sum_y) / (m_v + n);
+	}
+
+	// Sample the values for all groups at once
+	std::vector<double>& mu = theta[0];
+	std::vector<double>& tau = theta[1];
+	Util::rgamma_batch(a.data(), b.data(), tau.data(), num_groups, g);
+	for (int grp = 0; grp < num_groups; ++grp) {
+		prec[grp] = (m_v + stats[grp].n) * tau[grp];
+	}
+	Util::rnormal_batch(m.data(), prec.data(), mu.data(), num_groups, g);
+}
+
+// ==================================================== //
+
 #endif // SPPM_NORMAL_H_
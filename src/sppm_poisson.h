@@ -1,43 +1,236 @@
 #ifndef SPPM_POISSON_H_
 #define SPPM_POISSON_H_
 
-#include "sppm.h"
+#include "sppm_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "log.h"
+
+// ========================== //
+
+// Poisson likelihood with a conjugate Gamma prior on the relative risk:
+//   y_i | phi ~ Poisson(phi * e_i),  phi ~ G(a, b)
+class PoissonLikelihood {
+	public:
+		struct Stats {
+			double sum_y;
+			double sum_ei;
+
+			Stats() : sum_y(0.0), sum_ei(0.0) { }
+			void Merge(const Stats& other) {
+				sum_y += other.sum_y;
+				sum_ei += other.sum_ei;
+			}
+		};
+
+		static const int kNumParams = 1;
+		static const char* ParamName(int) { return "phi"; }
+
+		static const int kNumColumns = 2;
+		const double* Column(int k) const {
+			return k == 0 ? m_y.data() : m_ei.data();
+		}
+
+		PoissonLikelihood() : m_alpha(1), m_beta(1), m_log_const(0) { }
+
+		void SetAttributes(const lemon::SmartGraph& graph,
+			lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute,
+			std::string response, std::string expected);
+		void SetColumns(std::vector<double> response, std::vector<double> expected);
+		void SetParameters(double alpha, double beta);
+
+		// Whether the counts are integers (and lgamma is tabulated)
+		bool IntegerCounts() const { return !m_lgamma_shape.empty(); }
+
+		void Add(Stats& stats, int node) const {
+			stats.sum_y += m_y[node];
+			stats.sum_ei += m_ei[node];
+		}
+
+		void AddMoments(Stats& stats, const Util::Moments* moments) const {
+			stats.sum_y += moments[0].sum;
+			stats.sum_ei += moments[1].sum;
+		}
+
+		double LogMarginal(const Stats& stats) const {
+			double sum_y = stats.sum_y;
+			double result = m_log_const;
+			if (sum_y < m_lgamma_shape.size()) {
+				result += m_lgamma_shape[static_cast<size_t>(sum_y)];
+			} else {
+				result += lgamma(m_alpha + sum_y);
+			}
+			result -= (m_alpha + sum_y) * log(m_beta + stats.sum_ei);
+
+			SPPM_TRACE_EVENT(Util::kTracePoissonMarginal, sum_y, stats.sum_ei, result);
+			return result;
+		}
+
+		// Distance between the (smoothed) log relative risks
+		double Dissimilarity(int u, int v) const {
+			return std::fabs(log((m_y[u] + 0.5) / (m_ei[u] + 0.5))
+				- log((m_y[v] + 0.5) / (m_ei[v] + 0.5)));
+		}
+
+		template<class URNG>
+		void SamplePrior(std::vector<double>* theta, URNG& g) const;
+
+		template<class URNG>
+		void SamplePosterior(const std::vector<Stats>& stats,
+			std::vector<double>* theta, URNG& g);
+
+	private:
+		// Parameters
+		double m_alpha;
+		double m_beta;
+
+		// Attributes, indexed by node id
+		std::vector<double> m_y;
+		std::vector<double> m_ei;
+
+		// Predictive cache: a log b - lgamma(a) and lgamma(a + k) for the
+		// group counts k below kMaxLgammaTable (8 MB of table; empty if the
+		// counts are not integers). Larger counts call lgamma.
+		static const size_t kMaxLgammaTable = 1 << 20;
+		std::vector<double> m_lgamma_shape;
+		double m_log_const;
+
+		// Posterior parameters of every group (SamplePosterior scratch)
+		std::vector<double> m_post_alpha;
+		std::vector<double> m_post_beta;
+
+		void BuildPredictiveCache();
+};
 
 // ========================== //
 
-class SPPM_Poisson: public SPPM {
+class SPPM_Poisson: public SPPM_Model<PoissonLikelihood> {
 	public:
 		SPPM_Poisson(lemon::SmartGraph& graph,
 			lemon::SmartGraph::NodeMap<long long>& node_id,
-			lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute);
+			lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute,
+			const std::string& logger_id = SPPM_LOGGER)
+				: SPPM_Model<PoissonLikelihood>(graph, node_id, node_attribute,
+					logger_id) {
+			SAMPLER_LOG(INFO) << "== Initializing SPPM Poisson";
+		}
 
-		void SetAttributes(std::string response, std::string expected);
-		void SetGammaParameters(double alpha, double beta);
-	private:
+		void SetAttributes(std::string response, std::string expected) {
+			m_likelihood.SetAttributes(m_graph, m_node_attr, response, expected);
+			LogCounts();
+		}
 
-		// Parameters
-		double m_gamma_alpha;
-		double m_gamma_beta;
-		std::string m_attr_y;
-		std::string m_attr_ei;
-
-		// Current state
-		lemon::SmartGraph::NodeMap<double> m_phi;
-
-		// Output files
-		std::ofstream m_phi_file;
-
-		void PrepareOutputTheta();
-		void FinishOutputTheta();
-		void GenerateInitialTheta();
-		void HoldTheta();
-		void SampleTheta();
-
-		double ComputeLogPredictive(double sum_y, double sum_ei);
-		double ComputeLogRatioPredictive(lemon::SmartGraph::NodeMap<bool>& set_u,
-			lemon::SmartGraph::NodeMap<bool>& set_v);
+		// The attributes of each node, by node id
+		void SetAttributeColumns(std::vector<double> response,
+			std::vector<double> expected) {
+			m_likelihood.SetColumns(response, expected);
+			LogCounts();
+		}
+
+		void SetGammaParameters(double alpha, double beta) {
+			SAMPLER_LOG(INFO) << "== Setting parameters: phi ~ Gamma(alpha=" << alpha << ", beta=" << beta << ")";
+			m_likelihood.SetParameters(alpha, beta);
+		}
+
+	private:
+		void LogCounts() {
+			if (!m_likelihood.IntegerCounts()) {
+				SAMPLER_LOG(INFO) << " -- Non-integer counts: lgamma table disabled";
+			}
+		}
 };
 
+// ==================================================== //
+
+inline void PoissonLikelihood::SetAttributes(const lemon::SmartGraph& graph,
+	lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attribute,
+	std::string response, std::string expected) {
+
+	m_y.assign(graph.maxNodeId() + 1, 0.0);
+	m_ei.assign(graph.maxNodeId() + 1, 0.0);
+	for (lemon::SmartGraph::NodeIt u(graph); u != lemon::INVALID; ++u) {
+		m_y[graph.id(u)] = node_attribute[u][response];
+		m_ei[graph.id(u)] = node_attribute[u][expected];
+	}
+	BuildPredictiveCache();
+}
+
+// ========================== //
+
+inline void PoissonLikelihood::SetColumns(std::vector<double> response,
+	std::vector<double> expected) {
+	m_y.swap(response);
+	m_ei.swap(expected);
+	BuildPredictiveCache();
+}
+
+// ========================== //
+
+inline void PoissonLikelihood::SetParameters(double alpha, double beta) {
+	m_alpha = alpha;
+	m_beta = beta;
+	BuildPredictiveCache();
+}
+
 // ========================== //
 
+inline void PoissonLikelihood::BuildPredictiveCache() {
+	double a = m_alpha;
+	double b = m_beta;
+	m_log_const = a*log(b) - lgamma(a);
+
+	// The counts are integers, so any group sum of them is an integer between
+	// zero and the total count: tabulate lgamma(a + k) for all of them, up to
+	// kMaxLgammaTable entries. Non-integer responses, and the group sums past
+	// the table, fall back to calling lgamma.
+	m_lgamma_shape.clear();
+	double total = 0.0;
+	for (double y : m_y) {
+		if (y < 0 || y != floor(y)) return;
+		total += y;
+	}
+	m_lgamma_shape.resize(static_cast<size_t>(std::min(total + 1,
+		static_cast<double>(kMaxLgammaTable))));
+	for (size_t k = 0; k < m_lgamma_shape.size(); ++k) {
+		m_lgamma_shape[k] = lgamma(a + k);
+	}
+}
+
+// ========================== //
+
+template<class URNG>
+void PoissonLikelihood::SamplePrior(std::vector<double>* theta, URNG& g) const {
+	std::vector<double>& phi = theta[0];
+	for (size_t i = 0; i < phi.size(); ++i) {
+		phi[i] = Util::rgamma(m_alpha, m_beta, g);
+	}
+}
+
+// ========================== //
+
+template<class URNG>
+void PoissonLikelihood::SamplePosterior(const std::vector<Stats>& stats,
+	std::vector<double>* theta, URNG& g) {
+
+	// Posterior parameters: a + SUM_Y and b + SUM_EI
+	int num_groups = stats.size();
+	std::vector<double>& alpha = m_post_alpha;
+	std::vector<double>& beta = m_post_beta;
+	alpha.resize(num_groups);
+	beta.resize(num_groups);
+	for (int grp = 0; grp < num_groups; ++grp) {
+		alpha[grp] = m_alpha + stats[grp].sum_y;
+		beta[grp] = m_beta + stats[grp].sum_ei;
+	}
+
+	// Sample the values for all groups at once
+	Util::rgamma_batch(alpha.data(), beta.data(), theta[0].data(), num_groups, g);
+}
+
+// ==================================================== //
+
 #endif // SPPM_POISSON_H_
@@ -0,0 +1,99 @@
+/*
+   Copyright (C) 2014  Leonardo Vilela Teixeira
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   */
+
+// Decodes the binary trace written by 'sppm --trace' (see trace.h) into CSV
+// on the standard output: the time in nanoseconds since the start, the
+// thread, the event and its three values. The event names are read from the
+// file, so a trace can be decoded by a build with different events.
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "trace.h"
+
+using namespace std;
+
+DEFINE_string(event, "", "only decode the events with this name");
+
+static const char USAGE[] =
+R"(
+Usage:
+	sppm_trace [options] <trace file>
+
+The trace file is written by an sppm built with SPPM_TRACE, run with --trace.
+)";
+
+// ========================== //
+
+int main(int argc, char* argv[]) {
+	gflags::SetUsageMessage(USAGE);
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+	if (argc != 2) {
+		cerr << "Invalid usage." << endl;
+		cerr << USAGE << endl;
+		return 1;
+	}
+
+	ifstream file(argv[1], ios::binary);
+	char magic[sizeof(Util::kTraceMagic)];
+	uint32_t header[4];
+	uint64_t num_records = 0;
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+	file.read(reinterpret_cast<char*>(&num_records), sizeof(num_records));
+	if (!file || memcmp(magic, Util::kTraceMagic, sizeof(magic)) != 0) {
+		cerr << "Not a trace file: " << argv[1] << endl;
+		return 1;
+	}
+	if (header[1] != sizeof(Util::TraceRecord)) {
+		cerr << "Unsupported trace (version " << header[0] << ", records of "
+			<< header[1] << " bytes)" << endl;
+		return 1;
+	}
+
+	vector<string> names(header[2]);
+	for (string& name : names) {
+		uint32_t length = 0;
+		file.read(reinterpret_cast<char*>(&length), sizeof(length));
+		name.resize(length);
+		file.read(&name[0], length);
+	}
+
+	cout << "nanoseconds,thread,event,value1,value2,value3" << endl;
+	cout.precision(17);
+	Util::TraceRecord record;
+	for (uint64_t i = 0; i < num_records; ++i) {
+		if (!file.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+			cerr << "Trace truncated after " << i << " of " << num_records
+				<< " records" << endl;
+			return 1;
+		}
+		string name = record.event < names.size()
+			? names[record.event] : to_string(record.event);
+		if (!FLAGS_event.empty() && name != FLAGS_event) continue;
+		cout << record.nanoseconds << "," << record.thread << "," << name
+			<< "," << record.values[0] << "," << record.values[1] << ","
+			<< record.values[2] << "\n";
+	}
+	return 0;
+}
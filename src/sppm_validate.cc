@@ -0,0 +1,574 @@
+/*
+   Copyright (C) 2014  Leonardo Vilela Teixeira
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   */
+
+// Checks the samplers against the exact posterior on tiny graphs. For each
+// graph (up to ~8 nodes) every spanning forest T and every set of cut edges
+// C of T are enumerated; (T, C) gives the partition pi into the components
+// of T - C, with weight
+//   L(pi) B(a + |C|, b + |T| - |C|) / B(a, b)
+// (rho integrated out, uniform tree prior). L is computed here in closed form,
+// independently of the likelihood policies. Summing the weights gives the
+// exact posterior of the partition and of the tree.
+//
+// Long chains of each engine variant (tree sampler, split-merge moves,
+// threads, parallel tempering and each statistics kernel) are then run on
+// each graph and model, and their frequencies (of the cold chain, when
+// tempered) are compared to the exact posterior with a chi-square test, on
+// counts scaled to the effective sample size of the chain, and the total
+// variation distance. Exits with 1 if any test fails. The Kruskal sampler draws minimum
+// spanning trees of random weights, which are not uniform, so its tree
+// frequencies are only reported (its partitions are still checked).
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "easylogging++.h"
+#include <gflags/gflags.h>
+#include <lemon/smart_graph.h>
+
+#include "diagnostics.h"
+#include "graph_copy.h"
+#include "masked_moments.h"
+#include "scratch_directory.h"
+#include "sppm_normal.h"
+#include "sppm_poisson.h"
+#include "tempering.h"
+
+using namespace std;
+
+INITIALIZE_EASYLOGGINGPP
+
+// ========================== //
+
+DEFINE_string(filter, "", "run only the cases whose name contains this");
+DEFINE_uint64(iterations, 100000, "iterations per chain");
+DEFINE_uint64(burn_in, 1000, "burn-in of each chain");
+DEFINE_uint64(seed, 1, "random seed of the chains");
+DEFINE_double(min_p_value, 0.001, "smallest chi-square p-value that passes");
+
+static const char USAGE[] =
+R"(
+Usage:
+	sppm_validate [--filter=<name>] [--iterations=<n>] [--burn_in=<n>]
+)";
+
+// Hyperparameters of the checks
+static const double kRhoAlpha = 1.0;
+static const double kRhoBeta = 2.0;
+static const double kNormalA = 2.0;
+static const double kNormalB = 1.0;
+static const double kNormalM = 0.0;
+static const double kNormalV = 0.5;
+static const double kGammaA = 2.0;
+static const double kGammaB = 1.0;
+
+// Inverse temperature of the hottest replica of the tempered variants
+static const double kMinBeta = 0.3;
+
+// ========================== //
+
+struct TinyGraph {
+	string name;
+	int num_nodes;
+	vector<pair<int, int>> edges;
+};
+
+static vector<TinyGraph> Graphs() {
+	return {
+		// A square with a roof
+		{"house", 5, {{0, 1}, {1, 2}, {2, 3}, {3, 0}, {2, 4}, {3, 4}}},
+		// 2 x 3 and 2 x 4 lattices
+		{"lattice2x3", 6, {{0, 1}, {1, 2}, {3, 4}, {4, 5}, {0, 3}, {1, 4}, {2, 5}}},
+		{"lattice2x4", 8, {{0, 1}, {1, 2}, {2, 3}, {4, 5}, {5, 6}, {6, 7},
+			{0, 4}, {1, 5}, {2, 6}, {3, 7}}},
+		// Two components: a path and a triangle with a tail
+		{"islands", 7, {{0, 1}, {1, 2}, {3, 4}, {4, 5}, {5, 3}, {5, 6}}}
+	};
+}
+
+// ========================== //
+
+// An engine variant. The kernel is the statistics kernel it forces (the
+// default one if empty); with several replicas the chain is tempered.
+struct Variant {
+	string name;
+	SPPM::TreeSampler tree_sampler;
+	double split_merge_rate;
+	int num_threads;
+	int num_replicas;
+	string kernel;
+	bool uniform_trees;
+};
+
+static vector<Variant> Variants() {
+	vector<Variant> variants = {
+		{"kruskal", SPPM::kTreeKruskal, 0.0, 1, 1, "", false},
+		{"wilson", SPPM::kTreeWilson, 0.0, 1, 1, "", true},
+		{"kruskal+split-merge", SPPM::kTreeKruskal, 1.0, 1, 1, "", false},
+		{"wilson+split-merge", SPPM::kTreeWilson, 1.0, 1, 1, "", true},
+		{"kruskal, 2 threads", SPPM::kTreeKruskal, 0.0, 2, 1, "", false},
+		{"wilson, 2 threads", SPPM::kTreeWilson, 0.0, 2, 1, "", true},
+		{"wilson, 2 replicas", SPPM::kTreeWilson, 0.0, 1, 2, "", true}
+	};
+	for (const auto& kernel : Util::MaskedMomentsKernels()) {
+		variants.push_back({"wilson+split-merge, " + kernel.first + " kernel",
+			SPPM::kTreeWilson, 1.0, 1, 1, kernel.first, true});
+	}
+	return variants;
+}
+
+// ========================== //
+
+// Attributes of the nodes: the first half of the nodes has a lower mean
+struct Data {
+	vector<double> y;
+	vector<double> counts;
+	vector<double> expected;
+};
+
+static Data MakeData(int num_nodes) {
+	mt19937 rng(7);
+	normal_distribution<double> noise(0.0, 0.7);
+	Data data;
+	for (int i = 0; i < num_nodes; ++i) {
+		bool high = i >= num_nodes / 2;
+		data.y.push_back((high ? 1.5 : 0.0) + noise(rng));
+		data.expected.push_back(4.0 + i % 3);
+		poisson_distribution<int> count(data.expected.back() * (high ? 1.8 : 0.8));
+		data.counts.push_back(count(rng));
+	}
+	return data;
+}
+
+// ==================================================== //
+// Exact posterior
+// ==================================================== //
+
+// Closed-form log marginal likelihoods of a group
+static double NormalLogMarginal(const Data& data, const vector<int>& group) {
+	double n = group.size();
+	double mean = 0.0;
+	for (int i : group) mean += data.y[i];
+	mean /= n;
+	double ss = 0.0;
+	for (int i : group) ss += (data.y[i] - mean) * (data.y[i] - mean);
+	double b_n = kNormalB + 0.5 * ss
+		+ 0.5 * kNormalV * n * (mean - kNormalM) * (mean - kNormalM) / (kNormalV + n);
+	return -0.5 * n * log(2 * M_PI) + 0.5 * log(kNormalV / (kNormalV + n))
+		+ kNormalA * log(kNormalB) - lgamma(kNormalA)
+		+ lgamma(kNormalA + 0.5 * n) - (kNormalA + 0.5 * n) * log(b_n);
+}
+
+static double PoissonLogMarginal(const Data& data, const vector<int>& group) {
+	double sum_y = 0.0, sum_e = 0.0, result = 0.0;
+	for (int i : group) {
+		sum_y += data.counts[i];
+		sum_e += data.expected[i];
+		result += data.counts[i] * log(data.expected[i]) - lgamma(data.counts[i] + 1);
+	}
+	return result + kGammaA * log(kGammaB) - lgamma(kGammaA)
+		+ lgamma(kGammaA + sum_y) - (kGammaA + sum_y) * log(kGammaB + sum_e);
+}
+
+// ========================== //
+
+static int Find(vector<int>& parent, int u) {
+	while (parent[u] != u) u = parent[u] = parent[parent[u]];
+	return u;
+}
+
+// Labels of the components of the given edges, numbered by first node
+static string PartitionKey(int num_nodes, const vector<pair<int, int>>& edges) {
+	vector<int> parent(num_nodes);
+	iota(parent.begin(), parent.end(), 0);
+	for (const pair<int, int>& e : edges) {
+		parent[Find(parent, e.first)] = Find(parent, e.second);
+	}
+	map<int, int> label;
+	string key;
+	for (int u = 0; u < num_nodes; ++u) {
+		int root = Find(parent, u);
+		if (!label.count(root)) {
+			int next = label.size();
+			label[root] = next;
+		}
+		key += static_cast<char>('a' + label[root]);
+	}
+	return key;
+}
+
+// ========================== //
+
+struct Posterior {
+	map<string, double> partition;
+	map<unsigned, double> tree;
+};
+
+// The exact posterior, by enumeration. Trees are bitmasks of edge indices.
+static Posterior ExactPosterior(const TinyGraph& graph, const Data& data,
+	const string& model) {
+
+	int n = graph.num_nodes;
+	int m = graph.edges.size();
+	int num_components = 0;
+	for (char c : PartitionKey(n, graph.edges)) {
+		num_components = max(num_components, c - 'a' + 1);
+	}
+	int forest_size = n - num_components;
+
+	map<string, double> log_likelihood;
+	vector<pair<string, double>> terms;
+	vector<unsigned> term_tree;
+	for (unsigned tree = 0; tree < (1u << m); ++tree) {
+		if (__builtin_popcount(tree) != forest_size) continue;
+		vector<pair<int, int>> tree_edges;
+		for (int k = 0; k < m; ++k) {
+			if (tree & (1u << k)) tree_edges.push_back(graph.edges[k]);
+		}
+		// A spanning forest has as many components as the graph
+		if (PartitionKey(n, tree_edges) != PartitionKey(n, graph.edges)) continue;
+
+		for (unsigned cut = 0; cut < (1u << forest_size); ++cut) {
+			vector<pair<int, int>> kept;
+			for (int k = 0; k < forest_size; ++k) {
+				if (!(cut & (1u << k))) kept.push_back(tree_edges[k]);
+			}
+			string key = PartitionKey(n, kept);
+			if (!log_likelihood.count(key)) {
+				map<char, vector<int>> groups;
+				for (int u = 0; u < n; ++u) groups[key[u]].push_back(u);
+				double total = 0.0;
+				for (const auto& group : groups) {
+					total += model == "normal"
+						? NormalLogMarginal(data, group.second)
+						: PoissonLogMarginal(data, group.second);
+				}
+				log_likelihood[key] = total;
+			}
+			int num_cut = __builtin_popcount(cut);
+			double a = kRhoAlpha + num_cut;
+			double b = kRhoBeta + forest_size - num_cut;
+			terms.push_back(make_pair(key,
+				log_likelihood[key] + lgamma(a) + lgamma(b) - lgamma(a + b)));
+			term_tree.push_back(tree);
+		}
+	}
+
+	double max_term = -numeric_limits<double>::infinity();
+	for (const pair<string, double>& term : terms) max_term = max(max_term, term.second);
+	double total = 0.0;
+	for (const pair<string, double>& term : terms) total += exp(term.second - max_term);
+
+	Posterior posterior;
+	for (size_t t = 0; t < terms.size(); ++t) {
+		double p = exp(terms[t].second - max_term) / total;
+		posterior.partition[terms[t].first] += p;
+		posterior.tree[term_tree[t]] += p;
+	}
+	return posterior;
+}
+
+// ==================================================== //
+// Chains
+// ==================================================== //
+
+struct ChainSample {
+	vector<string> partition;
+	vector<unsigned> tree;
+	vector<double> num_groups;
+};
+
+// ========================== //
+
+static vector<vector<long long>> ReadRows(const string& filename) {
+	ifstream file(filename);
+	vector<vector<long long>> rows;
+	string line;
+	while (getline(file, line)) {
+		// Skip the header
+		if (line.empty() || !isdigit(line[0])) continue;
+		vector<long long> row;
+		istringstream fields(line);
+		string field;
+		while (getline(fields, field, ',')) row.push_back(stoll(field));
+		rows.push_back(row);
+	}
+	return rows;
+}
+
+// ========================== //
+
+// A sampler of the model on the graph, set up for the variant
+static unique_ptr<SPPM> CreateSampler(lemon::SmartGraph& graph,
+	lemon::SmartGraph::NodeMap<long long>& node_id,
+	lemon::SmartGraph::NodeMap<Util::AttrMap>& node_attr, const Data& data,
+	const string& model, const Variant& variant) {
+
+	unique_ptr<SPPM> sppm;
+	if (model == "normal") {
+		SPPM_Normal* normal = new SPPM_Normal(graph, node_id, node_attr);
+		normal->SetAttributeColumn(data.y);
+		normal->SetNormalGammaParameters(kNormalA, kNormalB, kNormalM, kNormalV);
+		sppm.reset(normal);
+	} else {
+		SPPM_Poisson* poisson = new SPPM_Poisson(graph, node_id, node_attr);
+		poisson->SetAttributeColumns(data.counts, data.expected);
+		poisson->SetGammaParameters(kGammaA, kGammaB);
+		sppm.reset(poisson);
+	}
+	sppm->SetRhoParameters(kRhoAlpha, kRhoBeta);
+	sppm->SetSeed(FLAGS_seed);
+	sppm->SetTreeSampler(variant.tree_sampler);
+	sppm->SetSplitMergeRate(variant.split_merge_rate);
+	sppm->SetNumThreads(variant.num_threads);
+	sppm->SetShowProgress(false);
+	return sppm;
+}
+
+// ========================== //
+
+static ChainSample RunChain(const TinyGraph& tiny, const Data& data,
+	const string& model, const Variant& variant) {
+
+	lemon::SmartGraph graph;
+	lemon::SmartGraph::NodeMap<long long> node_id(graph);
+	lemon::SmartGraph::NodeMap<Util::AttrMap> node_attr(graph);
+	vector<lemon::SmartGraph::Node> nodes;
+	for (int i = 0; i < tiny.num_nodes; ++i) {
+		nodes.push_back(graph.addNode());
+		node_id[nodes.back()] = i;
+	}
+	for (const pair<int, int>& e : tiny.edges) {
+		graph.addEdge(nodes[e.first], nodes[e.second]);
+	}
+
+	// The replicas past the first (the cold one) run on copies of the graph
+	vector<unique_ptr<GraphCopy>> copies;
+	vector<unique_ptr<SPPM>> replicas;
+	replicas.push_back(CreateSampler(graph, node_id, node_attr, data, model, variant));
+	for (int k = 1; k < variant.num_replicas; ++k) {
+		copies.emplace_back(new GraphCopy(graph, node_id, node_attr));
+		GraphCopy& copy = *copies.back();
+		replicas.push_back(CreateSampler(copy.graph, copy.node_id,
+			copy.node_attribute, data, model, variant));
+	}
+
+	string default_kernel = Util::MaskedMomentsKernelName();
+	if (!variant.kernel.empty()) Util::SetMaskedMomentsKernel(variant.kernel);
+	ScratchDirectory scratch("sppm_validate");
+	replicas[0]->SetOutputDirectory(scratch.Path());
+	if (variant.num_replicas == 1) {
+		replicas[0]->Run(FLAGS_iterations, FLAGS_burn_in, 1);
+	} else {
+		ParallelTempering tempering(replicas, kMinBeta);
+		tempering.SetSeed(FLAGS_seed);
+		tempering.Run(FLAGS_iterations, FLAGS_burn_in, 1);
+	}
+	Util::SetMaskedMomentsKernel(default_kernel);
+
+	// The first row is the initial state. The partition columns are in the
+	// graph iteration order (given by the header), the tree rows are pairs of
+	// node ids.
+	ChainSample sample;
+	vector<vector<long long>> pi_rows = ReadRows(scratch.Path() + "/pi.csv");
+	vector<vector<long long>> tree_rows = ReadRows(scratch.Path() + "/tree.csv");
+	vector<int> column_node;
+	for (lemon::SmartGraph::NodeIt u(graph); u != lemon::INVALID; ++u) {
+		column_node.push_back(node_id[u]);
+	}
+	map<pair<int, int>, int> edge_index;
+	for (size_t k = 0; k < tiny.edges.size(); ++k) {
+		edge_index[tiny.edges[k]] = k;
+		edge_index[make_pair(tiny.edges[k].second, tiny.edges[k].first)] = k;
+	}
+
+	for (size_t r = 1; r < pi_rows.size() && r < tree_rows.size(); ++r) {
+		vector<pair<int, int>> same;
+		map<long long, int> first_node;
+		for (size_t k = 0; k < pi_rows[r].size(); ++k) {
+			long long label = pi_rows[r][k];
+			if (first_node.count(label)) same.push_back(make_pair(first_node[label], column_node[k]));
+			else first_node[label] = column_node[k];
+		}
+		sample.partition.push_back(PartitionKey(tiny.num_nodes, same));
+		sample.num_groups.push_back(first_node.size());
+
+		unsigned tree = 0;
+		for (size_t k = 0; k + 1 < tree_rows[r].size(); k += 2) {
+			tree |= 1u << edge_index[make_pair(tree_rows[r][k], tree_rows[r][k + 1])];
+		}
+		sample.tree.push_back(tree);
+	}
+	return sample;
+}
+
+// ==================================================== //
+// Tests
+// ==================================================== //
+
+// Regularized upper incomplete gamma Q(a, x), for the chi-square p-value
+static double UpperGammaQ(double a, double x) {
+	if (x <= 0) return 1.0;
+	double log_prefix = -x + a * log(x) - lgamma(a);
+	if (x < a + 1) {
+		double term = 1.0 / a, sum = term;
+		for (int k = 1; k < 1000 && term > sum * 1e-15; ++k) {
+			term *= x / (a + k);
+			sum += term;
+		}
+		return 1.0 - sum * exp(log_prefix);
+	}
+	// Continued fraction (modified Lentz)
+	double b = x + 1 - a, c = 1e300, d = 1.0 / b, h = d;
+	for (int k = 1; k < 1000; ++k) {
+		double an = -k * (k - a);
+		b += 2;
+		d = an * d + b;
+		if (fabs(d) < 1e-300) d = 1e-300;
+		c = b + an / c;
+		if (fabs(c) < 1e-300) c = 1e-300;
+		d = 1.0 / d;
+		double delta = d * c;
+		h *= delta;
+		if (fabs(delta - 1) < 1e-15) break;
+	}
+	return exp(log_prefix) * h;
+}
+
+// ========================== //
+
+struct TestResult {
+	double tv;
+	double p_value;
+	int bins;
+};
+
+// Chi-square test of the observed states against the exact probabilities,
+// with the counts scaled to ess samples. States with fewer than 5 expected
+// samples are pooled into one bin.
+template <class Key>
+static TestResult Compare(const map<Key, double>& exact,
+	const vector<Key>& observed, double ess) {
+
+	map<Key, double> freq;
+	for (const Key& key : observed) freq[key] += 1.0 / observed.size();
+
+	TestResult result;
+	result.tv = 0.0;
+	for (const auto& state : exact) {
+		auto it = freq.find(state.first);
+		result.tv += fabs(state.second - (it == freq.end() ? 0.0 : it->second));
+	}
+	// States the chain visited that have no posterior mass
+	for (const auto& state : freq) {
+		if (!exact.count(state.first)) result.tv += state.second;
+	}
+	result.tv /= 2;
+
+	double chi2 = 0.0, pooled_expected = 0.0, pooled_observed = 0.0;
+	result.bins = 0;
+	for (const auto& state : exact) {
+		auto it = freq.find(state.first);
+		double o = ess * (it == freq.end() ? 0.0 : it->second);
+		double e = ess * state.second;
+		if (e < 5) {
+			pooled_expected += e;
+			pooled_observed += o;
+			continue;
+		}
+		chi2 += (o - e) * (o - e) / e;
+		result.bins++;
+	}
+	double outside = 0.0;
+	for (const auto& state : freq) {
+		if (!exact.count(state.first)) outside += ess * state.second;
+	}
+	pooled_observed += outside;
+	if (pooled_expected > 0) {
+		chi2 += (pooled_observed - pooled_expected) * (pooled_observed - pooled_expected)
+			/ pooled_expected;
+		result.bins++;
+	} else if (pooled_observed > 0) {
+		chi2 = numeric_limits<double>::infinity();
+	}
+	result.p_value = result.bins > 1 ? UpperGammaQ(0.5 * (result.bins - 1), 0.5 * chi2) : 1.0;
+	return result;
+}
+
+// ========================== //
+
+// Prints the result of a test; an unchecked test always passes
+static bool Report(const string& name, const TestResult& result, bool checked) {
+	bool ok = result.p_value >= FLAGS_min_p_value;
+	cout << "  " << left << setw(44) << name << right << fixed
+		<< " TV=" << setprecision(4) << result.tv
+		<< " p=" << setprecision(4) << setw(6) << result.p_value
+		<< " (" << result.bins << " bins)"
+		<< (!checked ? "  (not checked)" : ok ? "  ok" : "  FAIL") << endl;
+	return ok || !checked;
+}
+
+// ==================================================== //
+
+int main(int argc, char* argv[]) {
+	gflags::SetUsageMessage(USAGE);
+	gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+	// The sampler logs would drown the results
+	el::Loggers::getLogger(SPPM_LOGGER);
+	el::Configurations conf;
+	conf.setToDefault();
+	conf.setGlobally(el::ConfigurationType::Enabled, "false");
+	el::Loggers::reconfigureAllLoggers(conf);
+
+	int failed = 0;
+	for (const TinyGraph& graph : Graphs()) {
+		Data data = MakeData(graph.num_nodes);
+		for (string model : {"normal", "poisson"}) {
+			string name = graph.name + "/" + model;
+			if (name.find(FLAGS_filter) == string::npos) continue;
+
+			Posterior exact = ExactPosterior(graph, data, model);
+			cout << name << " (" << exact.partition.size() << " partitions, "
+				<< exact.tree.size() << " trees)" << endl;
+			for (const Variant& variant : Variants()) {
+				ChainSample sample = RunChain(graph, data, model, variant);
+				double ess = min<double>(sample.partition.size(),
+					Util::EffectiveSampleSize(sample.num_groups));
+				failed += !Report(variant.name + " partition",
+					Compare(exact.partition, sample.partition, ess), true);
+				failed += !Report(variant.name + " tree",
+					Compare(exact.tree, sample.tree, ess), variant.uniform_trees);
+			}
+		}
+	}
+
+	if (failed) cout << "FAILED: " << failed << " tests" << endl;
+	else cout << "All passed" << endl;
+	return failed ? 1 : 0;
+}
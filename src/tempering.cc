@@ -0,0 +1,130 @@
+#include "tempering.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+#include "easylogging++.h"
+#include "philox.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// The swap decisions have a stream of their own, apart from the ones the
+// replicas draw from (see SPPM::StreamKind)
+static const uint32_t kStreamSwap = 3u << 24;
+
+// ==================================================== //
+
+ParallelTempering::ParallelTempering(vector<unique_ptr<SPPM>>& replicas,
+	double min_beta)
+
+	: m_replicas(replicas), m_swap_interval(10), m_num_rounds(0),
+	  m_seed(0), m_chain(0) {
+
+	if (m_replicas.empty()) {
+		throw std::invalid_argument("Parallel tempering needs a replica.");
+	}
+
+	int num_replicas = m_replicas.size();
+	LOG(INFO) << "== Parallel tempering with " << num_replicas << " replicas";
+	m_beta.resize(num_replicas, 1.0);
+	for (int k = 1; k < num_replicas; ++k) {
+		m_beta[k] = pow(min_beta, static_cast<double>(k) / (num_replicas - 1));
+	}
+	for (int k = 0; k < num_replicas; ++k) {
+		m_replicas[k]->SetInverseTemperature(m_beta[k]);
+	}
+
+	m_attempts.assign(max(num_replicas - 1, 0), 0);
+	m_accepted.assign(max(num_replicas - 1, 0), 0);
+}
+
+// ========================== //
+
+void ParallelTempering::SetSwapInterval(int num_iter) {
+	LOG(INFO) << "== Swaps proposed every " << num_iter << " iteration(s)";
+	m_swap_interval = max(num_iter, 1);
+}
+
+// ========================== //
+
+void ParallelTempering::SetSeed(uint64_t seed, uint32_t chain) {
+	m_seed = seed;
+	m_chain = chain;
+
+	// Replica k of chain c draws from chain (k << 24) | c, so the cold one
+	// reproduces the untempered chain (up to the swaps)
+	for (size_t k = 0; k < m_replicas.size(); ++k) {
+		m_replicas[k]->SetSeed(seed, (static_cast<uint32_t>(k) << 24) | chain);
+	}
+}
+
+// ========================== //
+
+void ParallelTempering::Run(int num_iter, int burn_in, int step_size) {
+	int num_replicas = m_replicas.size();
+	LOG(INFO) << "== Running " << num_replicas << " tempered replicas for "
+		<< num_iter << " iterations";
+	LOG(INFO) << " -- Burn-in: " << burn_in << " | Step size: " << step_size;
+
+	// One thread per replica; only the cold one holds its samples
+	ThreadPool pool(num_replicas);
+	pool.ParallelFor(num_replicas, [&](int k) {
+		m_replicas[k]->Start(k == 0, num_iter);
+	});
+
+	LOG(INFO) << "== Starting now.";
+	for (int first = 1; first <= num_iter; first += m_swap_interval) {
+		int last = min(num_iter, first + m_swap_interval - 1);
+		pool.ParallelFor(num_replicas, [&](int k) {
+			for (int iter = first; iter <= last; ++iter) {
+				bool hold = k == 0 && SPPM::Held(iter, burn_in, step_size);
+				m_replicas[k]->Step(iter, hold);
+			}
+		});
+		ProposeSwaps(last);
+		if (m_replicas[0]->StopRequested()) {
+			LOG(INFO) << "== Stopping rule met at iteration " << last;
+			break;
+		}
+	}
+
+	for (int k = 0; k + 1 < num_replicas; ++k) {
+		double rate = m_attempts[k] ? double(m_accepted[k]) / m_attempts[k] : 0.0;
+		LOG(INFO) << " -- Swaps between beta=" << m_beta[k] << " and beta="
+			<< m_beta[k + 1] << ": " << m_accepted[k] << " of " << m_attempts[k]
+			<< " accepted (" << rate << ")";
+	}
+	LOG(INFO) << "== Finished running SPPM sampler";
+
+	m_replicas[0]->Finish();
+}
+
+// ========================== //
+
+void ParallelTempering::ProposeSwaps(int iteration) {
+	int num_replicas = m_replicas.size();
+	vector<double> log_lik(num_replicas);
+	for (int k = 0; k < num_replicas; ++k) {
+		log_lik[k] = m_replicas[k]->LogLikelihood();
+	}
+
+	// Even rounds pair (0,1), (2,3), ...; odd rounds pair (1,2), (3,4), ...
+	Util::Philox rng(m_seed, m_chain, iteration, kStreamSwap);
+	uniform_real_distribution<double> unif(0.0, 1.0);
+	for (int k = m_num_rounds % 2; k + 1 < num_replicas; k += 2) {
+		double log_ratio = (m_beta[k] - m_beta[k + 1]) * (log_lik[k + 1] - log_lik[k]);
+		m_attempts[k]++;
+		if (log(unif(rng)) < log_ratio) {
+			m_replicas[k]->SwapState(*m_replicas[k + 1]);
+			swap(log_lik[k], log_lik[k + 1]);
+			m_accepted[k]++;
+		}
+	}
+	m_num_rounds++;
+	VLOG(3) << " -- Cold chain log likelihood: " << log_lik[0];
+}
+
+// ==================================================== //
@@ -0,0 +1,52 @@
+#ifndef SPPM_TEMPERING_H_
+#define SPPM_TEMPERING_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "sppm.h"
+
+// ========================== //
+
+// Replica exchange (parallel tempering). K copies of a sampler run side by
+// side, one per thread, with the likelihood raised to a ladder of inverse
+// temperatures 1 = beta_0 > beta_1 > ... > beta_{K-1}. Every few iterations
+// neighbouring replicas propose to exchange their states, accepted with
+//
+//   min(1, exp((beta_i - beta_j) * (loglik(s_j) - loglik(s_i))))
+//
+// where loglik is the collapsed (theta integrated out) log likelihood. Hot
+// replicas cross between modes easily and hand their states down the
+// ladder. Only the cold replica (the actual posterior) writes samples.
+class ParallelTempering {
+	public:
+		// replicas[0] is the cold chain. All replicas must be samplers of the
+		// same model, on the same graph and with the same parameters. The
+		// inverse temperatures are spaced geometrically down to min_beta.
+		ParallelTempering(std::vector<std::unique_ptr<SPPM>>& replicas,
+			double min_beta);
+
+		void SetSwapInterval(int num_iter);
+		void SetSeed(uint64_t seed, uint32_t chain = 0);
+
+		void Run(int num_iter, int burn_in, int step_size);
+
+	private:
+		std::vector<std::unique_ptr<SPPM>>& m_replicas;
+		std::vector<double> m_beta;
+		int m_swap_interval;
+		int m_num_rounds;
+		uint64_t m_seed;
+		uint32_t m_chain;
+
+		// Swaps proposed and accepted between replicas k and k + 1
+		std::vector<int> m_attempts;
+		std::vector<int> m_accepted;
+
+		void ProposeSwaps(int iteration);
+};
+
+// ========================== //
+
+#endif // SPPM_TEMPERING_H_
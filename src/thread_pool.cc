@@ -0,0 +1,103 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+// ==================================================== //
+
+ThreadPool::ThreadPool(int num_threads)
+	: m_num_threads(num_threads < 1 ? 1 : num_threads), m_stop(false),
+	  m_generation(0), m_busy(0), m_task(nullptr), m_count(0), m_next(0) {
+
+	for (int i = 1; i < m_num_threads; ++i) {
+		m_workers.push_back(thread(&ThreadPool::WorkerLoop, this));
+	}
+}
+
+// ========================== //
+
+ThreadPool::~ThreadPool() {
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_work_cv.notify_all();
+	for (thread& worker : m_workers) {
+		worker.join();
+	}
+}
+
+// ========================== //
+
+void ThreadPool::ParallelFor(int count, const function<void(int)>& task) {
+	if (count <= 0) return;
+
+	// Nothing to share: run everything on the calling thread
+	if (m_workers.empty() || count == 1) {
+		for (int i = 0; i < count; ++i) task(i);
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_task = &task;
+		m_count = count;
+		m_next = 0;
+		m_error = nullptr;
+		m_busy = m_workers.size();
+		++m_generation;
+	}
+	m_work_cv.notify_all();
+
+	// The calling thread works too
+	RunTasks();
+
+	// Wait for the workers to drain the queue
+	unique_lock<mutex> lock(m_mutex);
+	m_done_cv.wait(lock, [this] { return m_busy == 0; });
+	m_task = nullptr;
+
+	if (m_error) {
+		exception_ptr error = m_error;
+		m_error = nullptr;
+		rethrow_exception(error);
+	}
+}
+
+// ========================== //
+
+void ThreadPool::WorkerLoop() {
+	unsigned long seen = 0;
+	while (true) {
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_work_cv.wait(lock, [&] { return m_stop || m_generation != seen; });
+			if (m_stop) return;
+			seen = m_generation;
+		}
+
+		RunTasks();
+
+		{
+			lock_guard<mutex> lock(m_mutex);
+			--m_busy;
+		}
+		m_done_cv.notify_one();
+	}
+}
+
+// ========================== //
+
+void ThreadPool::RunTasks() {
+	while (true) {
+		int i = m_next.fetch_add(1);
+		if (i >= m_count) break;
+		try {
+			(*m_task)(i);
+		} catch (...) {
+			lock_guard<mutex> lock(m_mutex);
+			if (!m_error) m_error = current_exception();
+		}
+	}
+}
+
+// ==================================================== //
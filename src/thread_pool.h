@@ -0,0 +1,53 @@
+#ifndef SPPM_THREAD_POOL_H_
+#define SPPM_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ========================== //
+
+// A small fixed-size pool of worker threads. The calling thread also takes
+// part in the work, so a pool of N threads spawns only N-1 workers (and a pool
+// of one thread runs everything inline).
+class ThreadPool {
+	public:
+		explicit ThreadPool(int num_threads = 1);
+		virtual ~ThreadPool();
+
+		int NumThreads() const { return m_num_threads; }
+
+		// Runs task(i) for every i in [0, count). Indices are handed out
+		// dynamically, one at a time, so tasks of very different sizes are
+		// balanced across threads. Blocks until every task is finished. If a
+		// task throws, the first exception is rethrown here.
+		void ParallelFor(int count, const std::function<void(int)>& task);
+
+	private:
+		int m_num_threads;
+		std::vector<std::thread> m_workers;
+
+		std::mutex m_mutex;
+		std::condition_variable m_work_cv;
+		std::condition_variable m_done_cv;
+		bool m_stop;
+		unsigned long m_generation;
+		int m_busy;
+
+		// Current job
+		const std::function<void(int)>* m_task;
+		int m_count;
+		std::atomic<int> m_next;
+		std::exception_ptr m_error;
+
+		void WorkerLoop();
+		void RunTasks();
+};
+
+// ========================== //
+
+#endif // SPPM_THREAD_POOL_H_
@@ -0,0 +1,123 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace Util {
+
+// ==================================================== //
+
+static const uint32_t kTraceVersion = 1;
+
+static const char* const kEventNames[kNumTraceEvents] = {
+	"iteration", "hold", "sweep", "split_merge", "rho", "tree", "theta",
+	"poisson_marginal"
+};
+
+// The ring buffer of a thread: the next slot to write and the number of
+// events of each kind seen, for the sampling
+struct ThreadTrace {
+	vector<TraceRecord> records;
+	uint64_t next;
+	uint32_t seen[kNumTraceEvents];
+	uint32_t thread;
+
+	ThreadTrace(size_t capacity, uint32_t id) : records(capacity), next(0), thread(id) {
+		fill(seen, seen + kNumTraceEvents, 0);
+	}
+};
+
+static mutex s_mutex;
+static vector<unique_ptr<ThreadTrace>> s_traces;
+static chrono::steady_clock::time_point s_start;
+static size_t s_capacity = 0;
+static uint32_t s_sample_every = 1;
+static thread_local ThreadTrace* t_trace = nullptr;
+
+atomic<bool> Trace::s_enabled(false);
+
+// ========================== //
+
+void Trace::Enable(size_t capacity, uint32_t sample_every) {
+	lock_guard<mutex> lock(s_mutex);
+	s_start = chrono::steady_clock::now();
+	s_capacity = max<size_t>(capacity, 1);
+	s_sample_every = max<uint32_t>(sample_every, 1);
+	s_enabled.store(true, memory_order_relaxed);
+}
+
+// ========================== //
+
+void Trace::Record(TraceEvent event, double a, double b, double c) {
+	if (!t_trace) {
+		lock_guard<mutex> lock(s_mutex);
+		s_traces.emplace_back(new ThreadTrace(s_capacity, s_traces.size()));
+		t_trace = s_traces.back().get();
+	}
+	if (t_trace->seen[event]++ % s_sample_every != 0) return;
+
+	TraceRecord& record = t_trace->records[t_trace->next++ % t_trace->records.size()];
+	record.nanoseconds = chrono::duration_cast<chrono::nanoseconds>(
+		chrono::steady_clock::now() - s_start).count();
+	record.event = event;
+	record.thread = t_trace->thread;
+	record.values[0] = a;
+	record.values[1] = b;
+	record.values[2] = c;
+}
+
+// ========================== //
+
+void Trace::Dump(const string& filename) {
+	lock_guard<mutex> lock(s_mutex);
+	vector<TraceRecord> records;
+	for (const unique_ptr<ThreadTrace>& trace : s_traces) {
+		size_t size = trace->records.size();
+		size_t count = min<uint64_t>(trace->next, size);
+		for (uint64_t i = trace->next - count; i < trace->next; ++i) {
+			records.push_back(trace->records[i % size]);
+		}
+	}
+	stable_sort(records.begin(), records.end(),
+		[](const TraceRecord& x, const TraceRecord& y) {
+			return x.nanoseconds < y.nanoseconds;
+		});
+
+	ofstream file(filename, ios::binary);
+	if (!file) {
+		throw std::ios_base::failure("Failed to open trace file: " + filename);
+	}
+	uint32_t header[4] = {kTraceVersion, sizeof(TraceRecord), kNumTraceEvents, 0};
+	uint64_t num_records = records.size();
+	file.write(kTraceMagic, sizeof(kTraceMagic));
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(&num_records), sizeof(num_records));
+	for (int e = 0; e < kNumTraceEvents; ++e) {
+		uint32_t length = strlen(kEventNames[e]);
+		file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+		file.write(kEventNames[e], length);
+	}
+	file.write(reinterpret_cast<const char*>(records.data()),
+		records.size() * sizeof(TraceRecord));
+	if (!file) {
+		throw std::ios_base::failure("Failed to write trace file: " + filename);
+	}
+}
+
+// ========================== //
+
+const char* Trace::EventName(TraceEvent event) {
+	return kEventNames[event];
+}
+
+// ==================================================== //
+
+};
@@ -0,0 +1,78 @@
+#ifndef SPPM_TRACE_H_
+#define SPPM_TRACE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Util {
+
+// ==================================================== //
+// Tracing of the sampler's hot paths. SPPM_TRACE_EVENT(event, values...)
+// compiles to nothing (its arguments are not even evaluated) unless the build
+// defines SPPM_TRACE (cmake -DSPPM_TRACE=ON). When compiled in and enabled,
+// every n-th event of each kind is stored, as a fixed-size binary record, in
+// a ring buffer of the thread (the oldest records are overwritten). Nothing is
+// formatted on the hot path: the buffers are dumped at the end of the run and
+// decoded offline by sppm_trace.
+// ==================================================== //
+
+enum TraceEvent {
+	kTraceIteration,        // iteration
+	kTraceHold,             // iteration, tree edges written
+	kTraceSweep,            // number of groups after the sweep
+	kTraceSplitMerge,       // boundaries moved, moves proposed
+	kTraceRho,              // posterior alpha and beta, new rho
+	kTraceTree,             // number of groups the tree joins
+	kTraceTheta,            // number of groups
+	kTracePoissonMarginal,  // sum of y, sum of E, log marginal
+	kNumTraceEvents
+};
+
+// One event. The file is a header (see Trace::Dump) followed by the records
+// of every thread, ordered by time.
+struct TraceRecord {
+	uint64_t nanoseconds;   // since Trace::Enable()
+	uint32_t event;
+	uint32_t thread;
+	double values[3];
+};
+
+// Dump file header: the magic, four 32-bit words (version, record size,
+// number of event names and a zero) and the 64-bit number of records. The
+// event names follow, each as a 32-bit length and the characters, then the
+// records.
+static const char kTraceMagic[8] = {'S', 'P', 'P', 'M', 'T', 'R', 'C', '1'};
+
+class Trace {
+	public:
+		// Starts recording every sample_every-th event of each kind, keeping
+		// the last capacity records of each thread
+		static void Enable(size_t capacity, uint32_t sample_every);
+		static bool Enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+		static void Record(TraceEvent event, double a = 0, double b = 0,
+			double c = 0);
+
+		// Writes the records of every thread, while no event is recorded
+		static void Dump(const std::string& filename);
+
+		static const char* EventName(TraceEvent event);
+
+	private:
+		static std::atomic<bool> s_enabled;
+};
+
+// ==================================================== //
+
+};
+
+#ifdef SPPM_TRACE
+#define SPPM_TRACE_EVENT(...) \
+	do { if (Util::Trace::Enabled()) Util::Trace::Record(__VA_ARGS__); } while (0)
+#else
+#define SPPM_TRACE_EVENT(...) do { } while (0)
+#endif
+
+#endif // SPPM_TRACE_H_